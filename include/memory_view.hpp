@@ -26,14 +26,241 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <list>
 #include <memory>
+#include <new>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MEMORY_VIEW_POSIX 1
+#endif
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define MEMORY_VIEW_IO_URING 1
+#endif
+
+#if __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#define MEMORY_VIEW_NUMA 1
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+// Kernels beyond SSE2 are compiled with target attributes and selected at
+// run time, so their intrinsics are needed regardless of compiler flags.
+#include <nmmintrin.h>
+#include <tmmintrin.h>
+#define MEMORY_VIEW_X86_DISPATCH 1
+#define MEMORY_VIEW_TARGET(isa) __attribute__((target(isa)))
+#else
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#define MEMORY_VIEW_TARGET(isa)
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 #include <gsl/span>
 
 namespace mv {
 
 class memory_view;
+class mutable_memory_view;
+
+namespace detail {
+struct mutable_view_source;
+}  // namespace detail
+
+template<typename T>
+class varint_sequence;
+
+template<unsigned Bits, typename T = std::uint32_t>
+class bitpacked_sequence;
+
+template<typename T>
+class sorted_view;
+
+template<typename T>
+class eytzinger_view;
+
+class indexed_view;
+
+/// Counters of events, which let tests and benchmarks check that an
+/// operation does not allocate, fetch, or copy more than expected.
+///
+/// Allocations are counted in programs that expand
+/// `MEMORY_VIEW_TRACE_ALLOCATIONS()`; fetches and copies only in the
+/// tracing build, enabled by defining `MEMORY_VIEW_TRACING`, e.g., with
+/// the CMake option of the same name.
+namespace trace {
+
+/// Events counted on a single thread.
+struct counters {
+    /// Heap allocations; only counted in programs that expand
+    /// `MEMORY_VIEW_TRACE_ALLOCATIONS()`.
+    std::uint64_t allocations = 0;
+    /// Ranges fetched from sources by views; only counted in the tracing
+    /// build.
+    std::uint64_t slices = 0;
+    /// Bytes copied from one buffer to another to serve data; only counted
+    /// in the tracing build.
+    std::uint64_t bytes_copied = 0;
+};
+
+/// \returns The counters of the calling thread.
+inline counters& thread_counters() noexcept
+{
+    thread_local counters values;
+    return values;
+}
+
+/// Counts the events of the calling thread from its construction on.
+class scope {
+public:
+    scope() : start_(thread_counters()) {}
+    ~scope() = default;
+    scope(const scope&) = default;
+    scope(scope&&) = default;
+    scope& operator=(const scope&) = default;
+    scope& operator=(scope&&) = default;
+
+    std::uint64_t allocations() const
+    {
+        return thread_counters().allocations - start_.allocations;
+    }
+    std::uint64_t slices() const { return thread_counters().slices - start_.slices; }
+    std::uint64_t bytes_copied() const
+    {
+        return thread_counters().bytes_copied - start_.bytes_copied;
+    }
+
+private:
+    counters start_;
+};
+
+}  // namespace trace
+
+#ifdef MEMORY_VIEW_TRACING
+#define MEMORY_VIEW_TRACE(counter, amount) \
+    (::mv::trace::thread_counters().counter += static_cast<std::uint64_t>(amount))
+#else
+#define MEMORY_VIEW_TRACE(counter, amount) ((void)0)
+#endif
+
+// GCC warns when the `std::free` of the replaced `operator delete` is
+// inlined into a caller of `operator new`, although they match here.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#define MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_BEGIN \
+    _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wmismatched-new-delete\"")
+#define MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_END _Pragma("GCC diagnostic pop")
+#else
+#define MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_BEGIN
+#define MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_END
+#endif
+
+/// Defines the global allocation functions, counting each allocation in
+/// `trace::counters`. Expand once per program, outside of any namespace.
+#define MEMORY_VIEW_TRACE_ALLOCATIONS()                                                                     \
+    MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_BEGIN                                                          \
+    void* operator new(std::size_t size)                                                                    \
+    {                                                                                                       \
+        ++::mv::trace::thread_counters().allocations;                                                       \
+        if (void* ptr = std::malloc(size > 0 ? size : 1)) { return ptr; }                                   \
+        throw std::bad_alloc();                                                                             \
+    }                                                                                                       \
+    void* operator new(std::size_t size, std::align_val_t alignment)                                        \
+    {                                                                                                       \
+        ++::mv::trace::thread_counters().allocations;                                                       \
+        auto align = static_cast<std::size_t>(alignment);                                                   \
+        if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) {                    \
+            return ptr;                                                                                     \
+        }                                                                                                   \
+        throw std::bad_alloc();                                                                             \
+    }                                                                                                       \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept                                    \
+    {                                                                                                       \
+        ++::mv::trace::thread_counters().allocations;                                                       \
+        return std::malloc(size > 0 ? size : 1);                                                            \
+    }                                                                                                       \
+    void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept        \
+    {                                                                                                       \
+        try {                                                                                               \
+            return operator new(size, alignment);                                                           \
+        } catch (const std::bad_alloc&) {                                                                   \
+            return nullptr;                                                                                 \
+        }                                                                                                   \
+    }                                                                                                       \
+    void* operator new[](std::size_t size) { return operator new(size); }                                   \
+    void* operator new[](std::size_t size, std::align_val_t alignment)                                      \
+    {                                                                                                       \
+        return operator new(size, alignment);                                                               \
+    }                                                                                                       \
+    void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept                              \
+    {                                                                                                       \
+        return operator new(size, tag);                                                                     \
+    }                                                                                                       \
+    void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept  \
+    {                                                                                                       \
+        return operator new(size, alignment, tag);                                                          \
+    }                                                                                                       \
+    void operator delete(void* ptr) noexcept { std::free(ptr); }                                            \
+    void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }                               \
+    void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }                          \
+    void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }             \
+    void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }                     \
+    void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }   \
+    void operator delete[](void* ptr) noexcept { std::free(ptr); }                                          \
+    void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }                             \
+    void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }                        \
+    void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }           \
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }                   \
+    void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); } \
+    MEMORY_VIEW_IGNORE_MISMATCHED_NEW_DELETE_END
 
 /// A handler manages the lifetime of a fetched memory area.
 /// When dealing with static memory, such as an in-memory array or a
@@ -52,253 +279,6044 @@ private:
     std::vector<char> data_{};
 };
 
-/// Represents the left end of a range when slicing.
-struct begin_t {} begin;
-
-/// Represents the right end of a range when slicing.
-struct end_t {} end;
-
-struct slice_data {
-    const char* ptr;
-    std::shared_ptr<base_handler> handler;
-};
-
-/// A view to an arbitrary memory buffer, such as array, or memory mapped file.
+/// A pool of byte buffers, grouped in power-of-two size classes.
 ///
-/// In a lazy memory source, any data access will cause to fetch
-/// the underlying data.
-/// No data is accessed when slicing.
-class memory_view {
+/// Released buffers are kept in per-class free lists (each with its own
+/// lock) and handed out again by later allocations of the same class.
+/// Allocations larger than the largest class bypass the pool.
+/// All buffers are aligned to `alignment` bytes.
+class buffer_pool {
 public:
-    /// Creates a memory view from a memory source.
-    ///
-    /// \tparam source_type
-    ///
-    /// This type must provide the following methods:
-    /// ```
-    /// span<char> as_span(std::ptrdiff_t begin, std::ptrdiff_t end) const;
-    /// std::size_t size() const;
-    /// ```
-    template<typename source_type>
-    memory_view(source_type source)
-        : self_(std::make_shared<model<source_type>>(source)),
-          begin_(0),
-          end_(self_->size())
-    {}
+    static constexpr std::size_t alignment = 64;
+    static constexpr std::size_t min_class_size = 64;
+    static constexpr std::size_t class_count = 20;
+    static constexpr std::size_t default_max_free_bytes = std::size_t{8} << 20;
 
-    memory_view() = default;
-    ~memory_view() = default;
-    memory_view(const memory_view&) = default;
-    memory_view(memory_view&&) noexcept = default;
-    memory_view& operator=(const memory_view&) = default;
-    memory_view& operator=(memory_view&&) noexcept = default;
+    /// \param max_free_bytes  Maximum number of bytes of free buffers kept
+    ///                        per size class, so that a class keeps fewer
+    ///                        buffers the larger they are, and none larger
+    ///                        than this.
+    explicit buffer_pool(std::size_t max_free_bytes = default_max_free_bytes)
+        : max_free_bytes_(max_free_bytes)
+    {}
 
-    /// Casts data to the given type, starting at the beginning of the range.
-    template<typename T>
-    T as() const
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool(buffer_pool&&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    buffer_pool& operator=(buffer_pool&&) = delete;
+    ~buffer_pool()
     {
-        return *reinterpret_cast<const T*>(ptr());
+        for (std::size_t cls = 0; cls < class_count; ++cls) {
+            for (void* buffer : classes_[cls].buffers) {
+                ::operator delete(buffer, std::align_val_t{alignment});
+            }
+        }
     }
 
-    /// Returns a span of the given type.
-    const char* as_ptr() const { return ptr(); }
-
-    /// Returns a span of the given type.
-    template<typename T>
-    gsl::span<const T> as_span() const
+    /// Returns a buffer of at least `size` bytes.
+    void* allocate(std::size_t size)
     {
-        return gsl::span<const T>(
-            reinterpret_cast<const T*>(ptr()), size() / sizeof(T));
+        if (size == 0) { return nullptr; }
+        auto cls = size_class(size);
+        if (cls < class_count) {
+            auto& free_list = classes_[cls];
+            std::lock_guard<std::mutex> lock(free_list.mutex);
+            if (!free_list.buffers.empty()) {
+                void* buffer = free_list.buffers.back();
+                free_list.buffers.pop_back();
+                return buffer;
+            }
+            size = min_class_size << cls;
+        }
+        return ::operator new(size, std::align_val_t{alignment});
     }
 
-    /// Unpacks the memory into several variables, returned as a tuple.
-    ///
-    /// Example:
-    /// ```
-    /// auto [n, ch, arr] = mv.unpack<int, char, std::array<char, 5>>();
-    /// ```
-    template<typename ...T>
-    std::tuple<T...> unpack() const
+    /// Returns a buffer obtained with `allocate(size)` to the pool.
+    void deallocate(void* buffer, std::size_t size)
     {
-        std::ptrdiff_t offset = sizeof(std::tuple<T...>);
-        return std::make_tuple(*cast_and_move<T>(ptr(), offset)...);
+        if (buffer == nullptr) { return; }
+        auto cls = size_class(size);
+        if (cls < class_count) {
+            auto& free_list = classes_[cls];
+            std::lock_guard<std::mutex> lock(free_list.mutex);
+            if (free_list.buffers.size() < max_free_bytes_ / (min_class_size << cls)) {
+                free_list.buffers.push_back(buffer);
+                return;
+            }
+        }
+        ::operator delete(buffer, std::align_val_t{alignment});
     }
 
-    /// Unpacks leading values and returns them along with the remaining slice.
-    template<typename ...T>
-    std::tuple<T..., memory_view> unpack_head() const
+    /// The pool used by default by `pooled_handler`.
+    /// It is never destroyed, so handlers may outlive static objects.
+    static buffer_pool& global()
     {
-        std::ptrdiff_t offset = sizeof(std::tuple<T...>);
-        auto tail = this->operator()(offset, mv::end);
-        auto head = std::make_tuple(*cast_and_move<T>(ptr(), offset)...);
-        return std::tuple_cat(head, std::tuple<memory_view>(tail));
+        static buffer_pool* pool = new buffer_pool();
+        return *pool;
     }
 
-    /// \returns The size of the view.
-    std::size_t size() const { return end_ - begin_; }
-
-    /// Equivalent to `size() == 0`
-    bool empty() const { return size() == 0; }
+private:
+    struct free_list {
+        std::mutex mutex;
+        std::vector<void*> buffers;
+    };
 
-    /// Returns a slice `[first, last)`.
-    memory_view operator()(std::ptrdiff_t first, std::ptrdiff_t last) const
+    static std::size_t size_class(std::size_t size)
     {
-        memory_view copy = *this;
-        copy.begin_ += first;
-        copy.end_ = begin_ + last;
-        copy.slice_ = slice_;
-        if (slice_.ptr != nullptr) {
-            std::advance(copy.slice_.ptr, first);
+        std::size_t cls = 0;
+        while (cls < class_count && (min_class_size << cls) < size) {
+            ++cls;
         }
-        return copy;
+        return cls;
     }
 
-    /// Returns a slice from `first` to the end of the view.
-    memory_view operator()(std::ptrdiff_t first, end_t) const
+    std::array<free_list, class_count> classes_{};
+    std::size_t max_free_bytes_ = 0;
+};
+
+/// Standard allocator drawing memory from a `buffer_pool`.
+template<typename T>
+class pool_allocator {
+public:
+    using value_type = T;
+
+    explicit pool_allocator(buffer_pool& pool) : pool_(&pool) {}
+
+    template<typename U>
+    pool_allocator(const pool_allocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(std::size_t n)
     {
-        memory_view copy = *this;
-        copy.begin_ += first;
-        copy.slice_ = slice_;
-        if (slice_.ptr != nullptr) {
-            std::advance(copy.slice_.ptr, first);
-        }
-        return copy;
+        return static_cast<T*>(pool_->allocate(n * sizeof(T)));
     }
+    void deallocate(T* ptr, std::size_t n) { pool_->deallocate(ptr, n * sizeof(T)); }
 
-    /// Returns a slice from the beginning of the view to last (exclusive).
-    memory_view operator()(begin_t, std::ptrdiff_t last) const
+    template<typename U>
+    bool operator==(const pool_allocator<U>& other) const
     {
-        memory_view copy = *this;
-        copy.end_ = begin_ + last;
-        copy.slice_ = slice_;
-        return copy;
+        return pool_ == other.pool_;
+    }
+    template<typename U>
+    bool operator!=(const pool_allocator<U>& other) const
+    {
+        return pool_ != other.pool_;
     }
 
 private:
-    struct source_concept {
-        source_concept() = default;
-        source_concept(const source_concept&) = default;
-        source_concept(source_concept&&) = default;
-        source_concept& operator=(const source_concept&) = default;
-        source_concept& operator=(source_concept&&) = default;
-        virtual ~source_concept() = default;
+    template<typename U>
+    friend class pool_allocator;
 
-        virtual const slice_data
-        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const = 0;
+    buffer_pool* pool_;
+};
 
-        virtual std::size_t size() const = 0;
-    };
+/// Handler owning a buffer from a `buffer_pool`, which is returned to the
+/// pool once the handler is destroyed.
+/// The pool must outlive the handler.
+class pooled_handler : public base_handler {
+public:
+    explicit pooled_handler(std::size_t size,
+                            buffer_pool& pool = buffer_pool::global())
+        : pool_(&pool),
+          data_(static_cast<char*>(pool.allocate(size))),
+          size_(size)
+    {}
 
-    template<typename source_type>
-    class model : public source_concept {
-    public:
-        explicit model(source_type source) : source_(std::move(source)) {}
+    pooled_handler() = delete;
+    pooled_handler(const pooled_handler&) = delete;
+    pooled_handler(pooled_handler&&) = delete;
+    pooled_handler& operator=(const pooled_handler&) = delete;
+    pooled_handler& operator=(pooled_handler&&) = delete;
+    ~pooled_handler() { pool_->deallocate(data_, size_); }
 
-        virtual const slice_data
-        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const override
-        {
-            return source_.slice(begin, end);
-        }
+    /// Creates a handler whose buffer and shared state are both allocated
+    /// from `pool`, so that no call to the global allocator is made once
+    /// the pool is warm.
+    static std::shared_ptr<pooled_handler>
+    make(std::size_t size, buffer_pool& pool = buffer_pool::global())
+    {
+        return std::allocate_shared<pooled_handler>(
+            pool_allocator<pooled_handler>(pool), size, pool);
+    }
 
-        std::size_t size() const override { return source_.size(); }
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
 
-    private:
-        source_type source_;
-    };
+private:
+    buffer_pool* pool_;
+    char* data_;
+    std::size_t size_;
+};
 
-    template<typename T>
-    static const T* cast_and_move(const char* ptr, std::ptrdiff_t& offset)
-    {
-        offset -= sizeof(T);
-        return reinterpret_cast<const T*>(ptr + offset);
-    }
+/// Represents the left end of a range when slicing.
+struct begin_t {} begin;
 
-    const char* ptr() const
-    {
-        if (slice_.ptr == nullptr) {
-            slice_ = self_->slice(begin_, end_);
-        }
-        return slice_.ptr;
-    }
+/// Represents the right end of a range when slicing.
+struct end_t {} end;
 
-    std::shared_ptr<source_concept> self_ = nullptr;
-    std::ptrdiff_t begin_ = 0;
-    std::ptrdiff_t end_ = 0;
-    mutable slice_data slice_ = {nullptr, nullptr};
+struct slice_data {
+    const char* ptr;
+    std::shared_ptr<base_handler> handler;
 };
 
-/// Memory source based on an existing contiguous memory area.
-/// **Warning**: any data passed to the constructors must be valid for the
-///              entire lifetime of the memory source. It must be enforced
-///              by the user. In the future, this will be deprecated in
-///              favor of a lifetime-aware solution (although most likely
-///              this will still be available to use with a warning in place).
-class ptr_memory_source {
-public:
-    ptr_memory_source(const char* ptr, std::size_t size)
-        : ptr_(ptr), len_(size) {}
+/// A writable slice of a source of a `mutable_memory_view`.
+struct mutable_slice_data {
+    char* ptr;
+    std::shared_ptr<base_handler> handler;
+};
 
-    template<int size>
-    ptr_memory_source(const std::array<char, size>& arr)
-        : ptr_(&arr[0]), len_(arr.size()) {}
+/// Whether flushing written data waits for it to reach the storage.
+enum class flush_mode { sync, async };
 
-    template<typename ContiguousContainer>
-    ptr_memory_source(const ContiguousContainer& container)
-        : ptr_(&container[0]), len_(container.size()) {}
+namespace detail {
 
-    ptr_memory_source() = default;
-    ~ptr_memory_source() = default;
-    ptr_memory_source(const ptr_memory_source&) = default;
-    ptr_memory_source(ptr_memory_source&) = default;
-    ptr_memory_source& operator=(const ptr_memory_source&) = default;
-    ptr_memory_source& operator=(ptr_memory_source&&) = default;
-    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+/// A writable pooled buffer for bytes `[begin, end)` of a source.
+/// The buffer is padded so that `data` is congruent to `begin` modulo
+/// `buffer_pool::alignment`, which lets sources that copy into pooled
+/// buffers guarantee the same alignment as a memory mapped file.
+struct pooled_slice {
+    static pooled_slice make(std::ptrdiff_t begin, std::ptrdiff_t end)
     {
-        return {std::next(ptr_, begin), nullptr};
+        auto pad = static_cast<std::size_t>(begin) % buffer_pool::alignment;
+        auto handler = pooled_handler::make(pad + (end - begin));
+        return {std::next(handler->data(), pad), std::move(handler)};
     }
-    std::size_t size() const { return len_; }
 
-private:
-    const char* ptr_ = nullptr;
-    std::size_t len_ = 0;
+    operator slice_data() const { return {data, handler}; }
+
+    char* data;
+    std::shared_ptr<pooled_handler> handler;
 };
 
-/// Memory source based on an input stream.
-/// Each data access reads from the stream.
-class istream_memory_source {
-public:
-    istream_memory_source(std::istream& stream, std::size_t size)
-        : stream_(stream), size_(size)
-    {}
+}  // namespace detail
 
-    istream_memory_source() = default;
-    ~istream_memory_source() = default;
-    istream_memory_source(const istream_memory_source&) = default;
-    istream_memory_source(istream_memory_source&) = default;
-    istream_memory_source& operator=(const istream_memory_source&) = default;
-    istream_memory_source& operator=(istream_memory_source&&) = default;
-    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
-    {
-        auto data_vector = read(begin, end);
-        auto handler = std::make_shared<owning_handler>(data_vector);
-        return {handler->data(), handler};
+/// A range `[begin, end)` of a memory source.
+struct byte_range {
+    std::ptrdiff_t begin;
+    std::ptrdiff_t end;
+};
+
+/// Describes the expected access pattern of a range.
+/// Sources may forward it to the operating system; sources that cannot
+/// make use of a hint simply ignore it.
+enum class access_hint { normal, sequential, random, willneed, hugepages };
+
+namespace detail {
+
+/// Whether `slice()` of `source_type` may be called from several threads
+/// at once. Sources that cannot declare
+/// `static constexpr bool thread_safe = false;`.
+template<typename source_type, typename = void>
+struct is_thread_safe : std::true_type {};
+
+template<typename source_type>
+struct is_thread_safe<source_type, std::void_t<decltype(source_type::thread_safe)>>
+    : std::bool_constant<source_type::thread_safe> {};
+
+template<typename source_type, typename = void>
+struct has_advise : std::false_type {};
+
+template<typename source_type>
+struct has_advise<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().advise(
+        std::ptrdiff_t{}, std::ptrdiff_t{}, access_hint{}))>>
+    : std::true_type {};
+
+template<typename source_type, typename = void>
+struct has_prefetch : std::false_type {};
+
+template<typename source_type>
+struct has_prefetch<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().prefetch(
+        std::ptrdiff_t{}, std::ptrdiff_t{}))>>
+    : std::true_type {};
+
+template<typename source_type, typename = void>
+struct has_slice_many : std::false_type {};
+
+template<typename source_type>
+struct has_slice_many<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().slice_many(
+        std::declval<gsl::span<const byte_range>>(),
+        std::declval<gsl::span<slice_data>>()))>>
+    : std::true_type {};
+
+/// Implements `slice_many` by merging overlapping ranges, as well as ranges
+/// separated by at most `gap` bytes, and fetching each merged range once
+/// with `fetch_many`. The slices of a merged range share its handler.
+///
+/// \tparam FetchMany   A callable with the signature of `slice_many`.
+template<typename FetchMany>
+void coalesced_slice_many(gsl::span<const byte_range> ranges,
+                          gsl::span<slice_data> out,
+                          std::ptrdiff_t gap,
+                          FetchMany fetch_many)
+{
+    std::vector<std::ptrdiff_t> order;
+    for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+        if (ranges[idx].begin < ranges[idx].end) {
+            order.push_back(idx);
+        } else {
+            out[idx] = {nullptr, nullptr};
+        }
     }
-    std::size_t size() const { return size_; }
+    std::sort(order.begin(), order.end(), [&](auto lhs, auto rhs) {
+        return ranges[lhs].begin < ranges[rhs].begin;
+    });
+    std::vector<byte_range> merged;
+    std::vector<std::size_t> owner(ranges.size());
+    for (auto idx : order) {
+        const auto& range = ranges[idx];
+        if (!merged.empty() && range.begin <= merged.back().end + gap) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        } else {
+            merged.push_back(range);
+        }
+        owner[idx] = merged.size() - 1;
+    }
+    std::vector<slice_data> fetched(merged.size());
+    fetch_many(gsl::span<const byte_range>(merged), gsl::span<slice_data>(fetched));
+    for (auto idx : order) {
+        const auto& data = fetched[owner[idx]];
+        auto offset = ranges[idx].begin - merged[owner[idx]].begin;
+        out[idx] = {std::next(data.ptr, offset), data.handler};
+    }
+}
 
-private:
-    std::vector<char> read(std::ptrdiff_t begin, std::ptrdiff_t end) const
-    {
-        auto length = end - begin;
-        if (length == 0) { return {}; }
-        std::vector<char> data(length);
-        stream_.seekg(begin);
-        stream_.read(&data[0], length);
-        return data;
+/// Calls `process(begin, end)` for consecutive chunks of `[0, size)` of
+/// `chunk_size` bytes, from up to `threads` threads, including the calling
+/// one; zero means one thread per hardware thread. Idle threads take the
+/// next chunk in order, which balances the load and lets sources be read
+/// sequentially.
+///
+/// \throws The first exception thrown by `process`, once all threads
+///         finished, or `std::system_error` if a thread cannot be started,
+///         once the started ones finished their current chunk.
+template<typename Process>
+void parallel_chunks(std::size_t size, std::size_t chunk_size, unsigned threads, Process process)
+{
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    auto chunks = (size + chunk_size - 1) / chunk_size;
+    if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, chunks));
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error = nullptr;
+    std::mutex mutex;
+    auto work = [&]() {
+        try {
+            for (auto idx = next++; idx < chunks; idx = next++) {
+                process(idx * chunk_size, std::min(size, (idx + 1) * chunk_size));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error == nullptr) { error = std::current_exception(); }
+            next = chunks;
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    try {
+        for (unsigned idx = 1; idx < threads; ++idx) { workers.emplace_back(work); }
+    } catch (...) {
+        next = chunks;
+        for (auto& worker : workers) { worker.join(); }
+        throw;
     }
+    work();
+    for (auto& worker : workers) { worker.join(); }
+    if (error != nullptr) { std::rethrow_exception(error); }
+}
 
-    std::istream& stream_;
-    std::size_t size_ = 0u;
-};
+template<typename source_type, typename = void>
+struct has_segments : std::false_type {};
+
+template<typename source_type>
+struct has_segments<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().segments(
+        std::ptrdiff_t{}, std::ptrdiff_t{}))>>
+    : std::true_type {};
+
+template<typename source_type, typename = void>
+struct is_borrowed : std::false_type {};
+
+template<typename source_type>
+struct is_borrowed<source_type, std::enable_if_t<source_type::borrowed>>
+    : std::true_type {};
+
+/// Whether `source_type` has a `slice` method returning `Slice`.
+template<typename source_type, typename Slice, typename = void>
+struct is_source : std::false_type {};
+
+template<typename source_type, typename Slice>
+struct is_source<source_type,
+                 Slice,
+                 std::enable_if_t<std::is_same<
+                     std::decay_t<decltype(std::declval<const source_type&>().slice(
+                         std::ptrdiff_t{}, std::ptrdiff_t{}))>,
+                     Slice>::value>>
+    : std::true_type {};
+
+template<typename source_type, typename = void>
+struct has_flush : std::false_type {};
+
+template<typename source_type>
+struct has_flush<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().flush(
+        std::ptrdiff_t{}, std::ptrdiff_t{}, flush_mode::sync))>>
+    : std::true_type {};
+
+template<typename source_type, typename = void>
+struct has_alignment : std::false_type {};
+
+template<typename source_type>
+struct has_alignment<source_type,
+    std::void_t<decltype(std::declval<const source_type&>().alignment())>>
+    : std::true_type {};
+
+/// \returns The alignment guaranteed by `source`, or 1 if it gives none.
+template<typename source_type>
+std::size_t alignment(const source_type& source)
+{
+    if constexpr (has_alignment<source_type>::value) {
+        return source.alignment();
+    } else {
+        return 1;
+    }
+}
+
+/// Reads a `T` from possibly misaligned memory.
+template<typename T>
+T load(const char* ptr)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be loaded from memory");
+    T value;
+    std::memcpy(&value, ptr, sizeof(T));
+    return value;
+}
+
+/// Asks `source` to start loading `[begin, end)`, falling back to
+/// `access_hint::willneed` for sources that only support hints.
+template<typename source_type>
+void prefetch(const source_type& source, std::ptrdiff_t begin, std::ptrdiff_t end)
+{
+    if constexpr (has_prefetch<source_type>::value) {
+        source.prefetch(begin, end);
+    } else if constexpr (has_advise<source_type>::value) {
+        source.advise(begin, end, access_hint::willneed);
+    }
+}
+
+}  // namespace detail
+
+/// The byte order of stored values.
+enum class endian {
+    little,
+    big,
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    native = big
+#else
+    native = little
+#endif
+};
+
+/// Tags a big-endian `T` in `as<be<T>>()` or `unpack<be<T>...>()`.
+template<typename T>
+struct be {};
+
+/// Tags a little-endian `T` in `as<le<T>>()` or `unpack<le<T>...>()`.
+template<typename T>
+struct le {};
+
+namespace detail {
+
+/// Maps a possibly tagged type to the stored type and its byte order.
+template<typename T>
+struct byte_order {
+    using type = T;
+    static constexpr endian order = endian::native;
+};
+
+template<typename T>
+struct byte_order<be<T>> {
+    using type = T;
+    static constexpr endian order = endian::big;
+};
+
+template<typename T>
+struct byte_order<le<T>> {
+    using type = T;
+    static constexpr endian order = endian::little;
+};
+
+template<typename T>
+using untagged_t = typename byte_order<T>::type;
+
+/// Reverses the bytes of an arithmetic or enumeration value.
+template<typename T>
+T byteswap(T value)
+{
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "only arithmetic and enumeration types can be byte swapped");
+    if constexpr (sizeof(T) == 1) {
+        return value;
+#if defined(__GNUC__)
+    } else if constexpr (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8) {
+        using bits_type = std::conditional_t<
+            sizeof(T) == 2,
+            std::uint16_t,
+            std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>;
+        bits_type bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        if constexpr (sizeof(T) == 2) {
+            bits = __builtin_bswap16(bits);
+        } else if constexpr (sizeof(T) == 4) {
+            bits = __builtin_bswap32(bits);
+        } else {
+            bits = __builtin_bswap64(bits);
+        }
+        std::memcpy(&value, &bits, sizeof(T));
+        return value;
+#endif
+    } else {
+        std::array<char, sizeof(T)> bytes;
+        std::memcpy(bytes.data(), &value, sizeof(T));
+        std::reverse(bytes.begin(), bytes.end());
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        return value;
+    }
+}
+
+/// \returns The number of trailing zero bits of `bits`, which is not zero.
+inline unsigned count_trailing_zeros(std::uint64_t bits)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+    unsigned count = 0;
+    for (; (bits & 1) == 0; bits >>= 1) { ++count; }
+    return count;
+#endif
+}
+
+/// \returns The number of set bits of `bits`.
+inline unsigned popcount(std::uint64_t bits)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcountll(bits));
+#else
+    bits -= (bits >> 1) & 0x5555555555555555ull;
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<unsigned>((bits * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/// Hints that the cache line holding `address` is read soon.
+inline void prefetch_cache_line(const void* address)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    static_cast<void>(address);
+#endif
+}
+
+#if defined(__SSSE3__) || defined(MEMORY_VIEW_X86_DISPATCH)
+
+/// \returns Whether the CPU supports SSSE3, checked once at run time
+///          unless it is enabled at compile time.
+inline bool has_ssse3()
+{
+#if defined(__SSSE3__)
+    return true;
+#else
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+#endif
+}
+
+/// \returns Whether the CPU supports SSE 4.2, checked once at run time
+///          unless it is enabled at compile time.
+inline bool has_sse42()
+{
+#if defined(__SSE4_2__)
+    return true;
+#else
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#endif
+}
+
+/// The SSSE3 kernel of `byteswap_copy()`.
+/// \returns The number of values copied: all but fewer than 16 bytes.
+template<typename T>
+MEMORY_VIEW_TARGET("ssse3")
+std::size_t byteswap_copy_ssse3(const char* in, T* out, std::size_t count)
+{
+    constexpr std::size_t lanes = 16 / sizeof(T);
+    __m128i mask;
+    if constexpr (sizeof(T) == 2) {
+        mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    } else if constexpr (sizeof(T) == 4) {
+        mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    } else {
+        mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    }
+    std::size_t idx = 0;
+    for (; idx + lanes <= count; idx += lanes) {
+        __m128i bytes = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(in + idx * sizeof(T)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx),
+                         _mm_shuffle_epi8(bytes, mask));
+    }
+    return idx;
+}
+
+#endif
+
+/// Copies `count` values from possibly misaligned `in` to `out`,
+/// reversing the bytes of each, 16 bytes at a time where supported.
+/// On x86-64, the SSSE3 kernel is selected at run time.
+template<typename T>
+void byteswap_copy(const char* in, T* out, std::size_t count)
+{
+    std::size_t idx = 0;
+    if constexpr (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8) {
+        constexpr std::size_t lanes = 16 / sizeof(T);
+#if defined(__SSSE3__) || defined(MEMORY_VIEW_X86_DISPATCH)
+        (void)lanes;
+        if (has_ssse3()) { idx = byteswap_copy_ssse3(in, out, count); }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        for (; idx + lanes <= count; idx += lanes) {
+            uint8x16_t bytes =
+                vld1q_u8(reinterpret_cast<const std::uint8_t*>(in + idx * sizeof(T)));
+            if constexpr (sizeof(T) == 2) {
+                bytes = vrev16q_u8(bytes);
+            } else if constexpr (sizeof(T) == 4) {
+                bytes = vrev32q_u8(bytes);
+            } else {
+                bytes = vrev64q_u8(bytes);
+            }
+            vst1q_u8(reinterpret_cast<std::uint8_t*>(out + idx), bytes);
+        }
+#else
+        (void)lanes;
+#endif
+    }
+    for (; idx < count; ++idx) {
+        out[idx] = byteswap(load<T>(in + idx * sizeof(T)));
+    }
+}
+
+/// Reads a `T` stored in the byte order `Order`.
+template<typename T, endian Order>
+T load(const char* ptr)
+{
+    if constexpr (Order == endian::native) {
+        return load<T>(ptr);
+    } else {
+        return byteswap(load<T>(ptr));
+    }
+}
+
+/// Writes a `T` to possibly misaligned memory in the byte order `Order`.
+template<typename T, endian Order = endian::native>
+void store(char* ptr, T value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be stored in memory");
+    if constexpr (Order != endian::native) {
+        value = byteswap(value);
+    }
+    std::memcpy(ptr, &value, sizeof(T));
+}
+
+template<typename... T>
+constexpr std::array<std::size_t, sizeof...(T)> packed_offsets()
+{
+    std::array<std::size_t, sizeof...(T)> sizes{sizeof(T)...};
+    std::array<std::size_t, sizeof...(T)> offsets{};
+    std::size_t position = 0;
+    for (std::size_t idx = 0; idx < sizes.size(); ++idx) {
+        offsets[idx] = position;
+        position += sizes[idx];
+    }
+    return offsets;
+}
+
+}  // namespace detail
+
+/// A field of a record layout: a `T` stored at `Offset` bytes from the
+/// beginning of the record in the byte order `Order`.
+///
+/// Fields of other orders than `endian::native` must be of arithmetic
+/// or enumeration types.
+template<typename T, std::size_t Offset, endian Order = endian::native>
+struct field {
+    using type = T;
+    static constexpr std::size_t offset = Offset;
+    static constexpr endian order = Order;
+
+    static T decode(const char* record) { return detail::load<T, Order>(record + Offset); }
+    static void encode(char* record, const T& value)
+    {
+        detail::store<T, Order>(record + Offset, value);
+    }
+};
+
+/// Describes a fixed-width record stored in memory, e.g.:
+/// ```
+/// using header = mv::layout<mv::field<std::uint32_t, 0, mv::endian::big>,
+///                           mv::field<std::uint16_t, 6>>;
+/// ```
+/// All offsets are known at compile time, so decoding a record involves
+/// no other computation than the loads themselves.
+/// The fields may be given in any order and may leave gaps between them.
+///
+/// \tparam Fields  Instances of `field`.
+template<typename... Fields>
+struct layout {
+    using tuple_type = std::tuple<typename Fields::type...>;
+    using columns_type = std::tuple<std::vector<typename Fields::type>...>;
+
+    /// The size of a record, which ends with the last byte of the last field.
+    static constexpr std::size_t size =
+        std::max({std::size_t{0}, (Fields::offset + sizeof(typename Fields::type))...});
+
+    /// Decodes the record at `record` into `Record`, which is either
+    /// `tuple_type` or an aggregate with the same member types, in order.
+    template<typename Record = tuple_type>
+    static Record decode(const char* record)
+    {
+        return Record{Fields::decode(record)...};
+    }
+
+    /// Writes the values of all fields to the record at `record`.
+    /// Bytes in gaps between fields are left untouched.
+    static void encode(char* record, const typename Fields::type&... values)
+    {
+        (Fields::encode(record, values), ...);
+    }
+
+    /// Decodes `count` consecutive records into a column per field.
+    /// Each column is filled in a separate pass with a constant stride,
+    /// which compilers can unroll and vectorize.
+    static void decode_columns(const char* records,
+                               std::size_t count,
+                               gsl::span<typename Fields::type>... columns)
+    {
+        (decode_column<Fields>(records, count, columns), ...);
+    }
+
+    /// Decodes `count` consecutive records into a vector per field.
+    static columns_type decode_columns(const char* records, std::size_t count)
+    {
+        columns_type columns{std::vector<typename Fields::type>(count)...};
+        std::apply(
+            [&](auto&... column) {
+                decode_columns(
+                    records, count, gsl::span<typename Fields::type>(column)...);
+            },
+            columns);
+        return columns;
+    }
+
+private:
+    template<typename Field>
+    static void decode_column(const char* records,
+                              std::size_t count,
+                              gsl::span<typename Field::type> column)
+    {
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            column[idx] = Field::decode(std::next(records, idx * size));
+        }
+    }
+};
+
+namespace detail {
+
+template<typename Indices, typename... T>
+struct packed_layout_impl;
+
+template<std::size_t... Idx, typename... T>
+struct packed_layout_impl<std::index_sequence<Idx...>, T...> {
+    using type = layout<field<untagged_t<T>,
+                              packed_offsets<untagged_t<T>...>()[Idx],
+                              byte_order<T>::order>...>;
+};
+
+}  // namespace detail
+
+/// Layout of values of types `T...` stored one after another, without any
+/// padding. Values are in native byte order, unless tagged with `be` or `le`.
+template<typename... T>
+using packed_layout =
+    typename detail::packed_layout_impl<std::index_sequence_for<T...>, T...>::type;
+
+/// A read-only sequence of `T` values stored in possibly misaligned memory.
+///
+/// Unlike `gsl::span`, the elements are not accessed through a `T` pointer
+/// but copied out one by one, which is well defined for any address and
+/// compiles to plain loads on targets that allow unaligned access.
+template<typename T>
+class unaligned_span {
+public:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be loaded from memory");
+
+    class iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = T;
+
+        iterator() = default;
+        explicit iterator(const char* ptr) : ptr_(ptr) {}
+
+        T operator*() const { return detail::load<T>(ptr_); }
+        T operator[](difference_type n) const { return *(*this + n); }
+
+        iterator& operator++() { return *this += 1; }
+        iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+        iterator& operator--() { return *this -= 1; }
+        iterator operator--(int) { auto copy = *this; --*this; return copy; }
+        iterator& operator+=(difference_type n)
+        {
+            std::advance(ptr_, n * static_cast<difference_type>(sizeof(T)));
+            return *this;
+        }
+        iterator& operator-=(difference_type n) { return *this += -n; }
+        friend iterator operator+(iterator it, difference_type n) { return it += n; }
+        friend iterator operator+(difference_type n, iterator it) { return it += n; }
+        friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(iterator lhs, iterator rhs)
+        {
+            return (lhs.ptr_ - rhs.ptr_) / static_cast<difference_type>(sizeof(T));
+        }
+
+        friend bool operator==(iterator lhs, iterator rhs) { return lhs.ptr_ == rhs.ptr_; }
+        friend bool operator!=(iterator lhs, iterator rhs) { return lhs.ptr_ != rhs.ptr_; }
+        friend bool operator<(iterator lhs, iterator rhs) { return lhs.ptr_ < rhs.ptr_; }
+        friend bool operator>(iterator lhs, iterator rhs) { return lhs.ptr_ > rhs.ptr_; }
+        friend bool operator<=(iterator lhs, iterator rhs) { return lhs.ptr_ <= rhs.ptr_; }
+        friend bool operator>=(iterator lhs, iterator rhs) { return lhs.ptr_ >= rhs.ptr_; }
+
+    private:
+        const char* ptr_ = nullptr;
+    };
+
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = iterator;
+
+    unaligned_span(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+    unaligned_span() = default;
+    ~unaligned_span() = default;
+    unaligned_span(const unaligned_span&) = default;
+    unaligned_span(unaligned_span&&) noexcept = default;
+    unaligned_span& operator=(const unaligned_span&) = default;
+    unaligned_span& operator=(unaligned_span&&) noexcept = default;
+
+    T operator[](std::size_t idx) const
+    {
+        return detail::load<T>(std::next(data_, idx * sizeof(T)));
+    }
+
+    iterator begin() const { return iterator(data_); }
+    iterator end() const { return iterator(std::next(data_, size_ * sizeof(T))); }
+
+    /// \returns The underlying bytes.
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+namespace detail {
+
+/// Data access and slicing shared by `memory_view` and `basic_memory_view`.
+///
+/// `Derived` must give this class access to its `begin_` and `end_` members,
+/// as well as to the following methods:
+/// ```
+/// const char* ptr() const;
+/// Derived subview(std::ptrdiff_t first, std::ptrdiff_t last) const;
+/// std::size_t source_alignment() const;
+/// ```
+/// where `source_alignment()` is the alignment guaranteed by the source
+/// (see `memory_view::memory_view()`), or 1 if it gives none.
+template<typename Derived>
+class view_interface {
+public:
+    /// Reads a value of the given type at the beginning of the range.
+    /// The data does not need to be aligned.
+    /// A type tagged as `be<T>` or `le<T>` is converted from the given byte
+    /// order and returned as `T`.
+    template<typename T>
+    untagged_t<T> as() const
+    {
+        return load<untagged_t<T>, byte_order<T>::order>(self().ptr());
+    }
+
+    /// Returns a pointer to the beginning of the data.
+    const char* as_ptr() const { return self().ptr(); }
+
+    /// Fetches the data now, if it has not been fetched yet.
+    ///
+    /// Slices taken from a fetched view point into its data instead of
+    /// fetching their own, so materializing a view before slicing it into
+    /// fields fetches it once.
+    const Derived& materialize() const
+    {
+        self().ptr();
+        return self();
+    }
+
+    /// Returns a span of the given type.
+    ///
+    /// The data must be aligned for `T`, which `is_aligned()` tells.
+    /// Data that may be misaligned can be read with `as_unaligned_span()`,
+    /// or with `with_span()`, which takes the fast path when it can.
+    template<typename T>
+    gsl::span<const T> as_span() const
+    {
+        const char* ptr = self().ptr();
+        assert(aligned<T>(ptr) && "as_span: data not aligned");
+        return gsl::span<const T>(
+            reinterpret_cast<const T*>(ptr), size() / sizeof(T));
+    }
+
+    /// Returns the data as big-endian values of type `T`.
+    ///
+    /// If that is the native byte order and the data is aligned, the data
+    /// is returned directly, as by `as_span()`. Otherwise, it is converted
+    /// into `buffer`, and the used part of it is returned.
+    ///
+    /// \throws std::out_of_range if the data must be converted but does not
+    ///         fit into `buffer`.
+    template<typename T>
+    gsl::span<const T> as_span_be(gsl::span<T> buffer) const
+    {
+        return as_ordered_span<T, endian::big>(buffer);
+    }
+
+    /// Returns the data as little-endian values of type `T`;
+    /// see `as_span_be()`.
+    template<typename T>
+    gsl::span<const T> as_span_le(gsl::span<T> buffer) const
+    {
+        return as_ordered_span<T, endian::little>(buffer);
+    }
+
+    /// Returns a span of the given type that accepts misaligned data.
+    template<typename T>
+    unaligned_span<T> as_unaligned_span() const
+    {
+        return unaligned_span<T>(self().ptr(), size() / sizeof(T));
+    }
+
+    /// Calls `fn` with either `as_span<T>()`, if the data is aligned for `T`,
+    /// or `as_unaligned_span<T>()` otherwise, and returns its result.
+    /// `fn` must accept both, e.g., by being a generic lambda.
+    template<typename T, typename Fn>
+    decltype(auto) with_span(Fn fn) const
+    {
+        const char* ptr = self().ptr();
+        if (aligned<T>(ptr)) {
+            return fn(gsl::span<const T>(
+                reinterpret_cast<const T*>(ptr), size() / sizeof(T)));
+        }
+        return fn(unaligned_span<T>(ptr, size() / sizeof(T)));
+    }
+
+    /// \returns Whether the data is aligned for `T`.
+    ///
+    /// If the source guarantees the alignment of `T`, no data is accessed.
+    template<typename T>
+    bool is_aligned() const
+    {
+        if (self().source_alignment() % alignof(T) == 0) {
+            return self().begin_ % static_cast<std::ptrdiff_t>(alignof(T)) == 0;
+        }
+        return aligned<T>(self().ptr());
+    }
+
+    /// Unpacks the memory into several variables, returned as a tuple.
+    /// The values are read one after another, without any padding,
+    /// as described by `packed_layout<T...>`.
+    ///
+    /// Example:
+    /// ```
+    /// auto [n, ch, arr] = mv.unpack<int, char, std::array<char, 5>>();
+    /// ```
+    template<typename ...T>
+    std::tuple<untagged_t<T>...> unpack() const
+    {
+        return packed_layout<T...>::decode(self().ptr());
+    }
+
+    /// Unpacks leading values and returns them along with the remaining slice.
+    template<typename ...T>
+    std::tuple<untagged_t<T>..., Derived> unpack_head() const
+    {
+        using head_layout = packed_layout<T...>;
+        auto tail = this->operator()(
+            static_cast<std::ptrdiff_t>(head_layout::size), mv::end);
+        return std::tuple_cat(head_layout::decode(self().ptr()),
+                              std::tuple<Derived>(std::move(tail)));
+    }
+
+    /// Decodes the record at the beginning of the range, described by
+    /// `Layout`, into `Record`; see `layout::decode()`.
+    template<typename Layout, typename Record = typename Layout::tuple_type>
+    Record decode() const
+    {
+        return Layout::template decode<Record>(self().ptr());
+    }
+
+    /// Decodes all consecutive records described by `Layout` into
+    /// a vector per field.
+    template<typename Layout>
+    typename Layout::columns_type decode_columns() const
+    {
+        return Layout::decode_columns(self().ptr(), size() / Layout::size);
+    }
+
+    /// Decodes all consecutive records described by `Layout` into the
+    /// given columns, one per field.
+    ///
+    /// \throws std::out_of_range if any of the columns is too short.
+    template<typename Layout, typename... T>
+    void decode_columns(gsl::span<T>... columns) const
+    {
+        auto count = size() / Layout::size;
+        if (((static_cast<std::size_t>(columns.size()) < count) || ...)) {
+            throw std::out_of_range("decode_columns: column too short");
+        }
+        Layout::decode_columns(self().ptr(), count, columns...);
+    }
+
+    /// \returns The size of the view.
+    std::size_t size() const { return self().end_ - self().begin_; }
+
+    /// Equivalent to `size() == 0`
+    bool empty() const { return size() == 0; }
+
+    /// Interprets the view as a sequence of LEB128 variable-byte integers.
+    template<typename T>
+    varint_sequence<T> as_varint_sequence() const
+    {
+        return varint_sequence<T>(memory_view(self()));
+    }
+
+    /// Interprets the view as `count` integers of `Bits` bits each.
+    template<unsigned Bits, typename T = std::uint32_t>
+    bitpacked_sequence<Bits, T> as_bitpacked(std::size_t count) const
+    {
+        return bitpacked_sequence<Bits, T>(memory_view(self()), count);
+    }
+
+    /// Interprets the entire view as integers of `Bits` bits each.
+    template<unsigned Bits, typename T = std::uint32_t>
+    bitpacked_sequence<Bits, T> as_bitpacked() const
+    {
+        return as_bitpacked<Bits, T>(size() * 8 / Bits);
+    }
+
+    /// Interprets the view as a sorted array of `T`, to search it.
+    /// Data not aligned to `T` is copied.
+    template<typename T>
+    sorted_view<T> as_sorted() const
+    {
+        return sorted_view<T>(memory_view(self()));
+    }
+
+    /// Interprets the view as an array of `T` in Eytzinger order, as
+    /// produced by `eytzinger_layout()`, to search it.
+    /// Data not aligned to `T` is copied.
+    template<typename T>
+    eytzinger_view<T> as_eytzinger() const
+    {
+        return eytzinger_view<T>(memory_view(self()));
+    }
+
+    /// Interprets the view as variable-length records, as written by
+    /// `encode_indexed()`.
+    /// \throws std::runtime_error if the data is not a valid record file.
+    indexed_view as_indexed() const;
+
+    /// Returns a slice `[first, last)`.
+    Derived operator()(std::ptrdiff_t first, std::ptrdiff_t last) const
+    {
+        return self().subview(first, last);
+    }
+
+    /// Returns a slice from `first` to the end of the view.
+    Derived operator()(std::ptrdiff_t first, end_t) const
+    {
+        return self().subview(first, self().end_ - self().begin_);
+    }
+
+    /// Returns a slice from the beginning of the view to last (exclusive).
+    Derived operator()(begin_t, std::ptrdiff_t last) const
+    {
+        return self().subview(0, last);
+    }
+
+protected:
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+    template<typename T, endian Order>
+    gsl::span<const T> as_ordered_span(gsl::span<T> buffer) const
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "only arithmetic and enumeration types can be byte swapped");
+        const char* ptr = self().ptr();
+        auto count = size() / sizeof(T);
+        if (Order == endian::native && aligned<T>(ptr)) {
+            return gsl::span<const T>(reinterpret_cast<const T*>(ptr), count);
+        }
+        if (static_cast<std::size_t>(buffer.size()) < count) {
+            throw std::out_of_range("as_span: buffer too short");
+        }
+        MEMORY_VIEW_TRACE(bytes_copied, count * sizeof(T));
+        if constexpr (Order == endian::native) {
+            std::copy_n(ptr, count * sizeof(T), reinterpret_cast<char*>(buffer.data()));
+        } else {
+            byteswap_copy(ptr, buffer.data(), count);
+        }
+        return gsl::span<const T>(buffer.data(), count);
+    }
+
+    template<typename T>
+    static bool aligned(const char* ptr)
+    {
+        return reinterpret_cast<std::uintptr_t>(ptr) % alignof(T) == 0;
+    }
+};
+
+}  // namespace detail
+
+/// A view to an arbitrary memory buffer, such as array, or memory mapped file.
+///
+/// In a lazy memory source, any data access will cause to fetch
+/// the underlying data.
+/// No data is accessed when slicing.
+class memory_view : public detail::view_interface<memory_view> {
+public:
+    /// Creates a memory view from a memory source.
+    ///
+    /// \tparam source_type
+    ///
+    /// This type must provide the following methods:
+    /// ```
+    /// const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const;
+    /// std::size_t size() const;
+    /// ```
+    /// Optionally, it can also provide:
+    /// ```
+    /// void advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint) const;
+    /// void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const;
+    /// void slice_many(gsl::span<const byte_range> ranges,
+    ///                 gsl::span<slice_data> out) const;
+    /// std::vector<memory_view> segments(std::ptrdiff_t begin,
+    ///                                   std::ptrdiff_t end) const;
+    /// std::size_t alignment() const;
+    /// ```
+    /// A source that returns `alignment()` guarantees that the pointer of
+    /// every slice starting at `begin` is congruent to `begin` modulo that
+    /// value, so that `is_aligned()` can be answered without a fetch.
+    /// A source over static memory, which is never invalidated and needs
+    /// no handler, can declare `static constexpr bool borrowed = true;`.
+    /// Its data is then resolved once, the source itself is not kept, and
+    /// copying or slicing the view involves no reference counting.
+    template<typename source_type,
+             typename = std::enable_if_t<detail::is_source<source_type, slice_data>::value>>
+    memory_view(source_type source) : begin_(0)
+    {
+        if constexpr (detail::is_borrowed<source_type>::value) {
+            end_ = source.size();
+            slice_ = source.slice(0, end_);
+        } else {
+            self_ = std::make_shared<model<source_type>>(std::move(source));
+            end_ = self_->size();
+        }
+    }
+
+    memory_view() = default;
+    ~memory_view() = default;
+    memory_view(const memory_view&) = default;
+    memory_view(memory_view&&) noexcept = default;
+    memory_view& operator=(const memory_view&) = default;
+    memory_view& operator=(memory_view&&) noexcept = default;
+
+    /// Passes an access hint for the viewed range to the memory source.
+    /// No data is accessed.
+    void advise(access_hint hint) const
+    {
+        if (self_ != nullptr) {
+            self_->advise(begin_, end_, hint);
+        }
+    }
+
+    /// Asks the memory source to start loading the viewed range in the
+    /// background, so that a later access does not wait for it.
+    /// This is only a hint: no data is accessed, and sources that cannot
+    /// load asynchronously ignore it.
+    void prefetch() const
+    {
+        if (self_ != nullptr && slice_.ptr == nullptr) {
+            self_->prefetch(begin_, end_);
+        }
+    }
+
+    /// Splits the view into contiguous parts of the underlying storage.
+    ///
+    /// For sources that consist of several discontiguous buffers, such as
+    /// `chained_memory_source`, each returned view lies within one buffer,
+    /// so accessing it never copies. Other sources return a single segment.
+    /// No data is accessed.
+    std::vector<memory_view> segments() const
+    {
+        std::vector<memory_view> parts;
+        if (self_ != nullptr) {
+            parts = self_->segments(begin_, end_);
+        }
+        if (parts.empty()) {
+            parts.push_back(*this);
+        }
+        return parts;
+    }
+
+    /// Returns a copy of this view that can be safely shared between threads.
+    ///
+    /// Concurrent first accesses to a synchronized view collapse into a single
+    /// fetch from the source, and slices of it are synchronized as well.
+    /// By default, views are not synchronized: the fetch has no overhead,
+    /// but accessing the same view object from several threads is a data
+    /// race. Distinct copies of a view can always be used concurrently.
+    memory_view synchronized() const
+    {
+        memory_view copy = *this;
+        copy.fetch_ = std::make_shared<fetch_state>(begin_, end_, false);
+        return copy;
+    }
+
+    /// Returns a copy of this view whose slices share a single fetch.
+    ///
+    /// By default, a slice taken before its parent is accessed fetches only
+    /// its own range, so accessing several fields of a record fetches each
+    /// of them separately. All views derived from a grouped view, including
+    /// slices of slices, instead fetch the entire grouped range on their
+    /// first access and point into it afterwards.
+    /// A grouped view is also synchronized.
+    memory_view grouped() const
+    {
+        memory_view copy = *this;
+        copy.fetch_ = std::make_shared<fetch_state>(begin_, end_, true);
+        return copy;
+    }
+
+    /// \returns Whether the view was created with `synchronized()` or
+    ///          `grouped()`, or derived from such a view.
+    bool is_synchronized() const { return fetch_ != nullptr; }
+
+    friend void fetch(gsl::span<memory_view> views);
+    friend class memory_cursor;
+    friend class detail::view_interface<memory_view>;
+    template<typename Source>
+    friend class basic_memory_view;
+
+private:
+    struct source_concept {
+        source_concept() = default;
+        source_concept(const source_concept&) = default;
+        source_concept(source_concept&&) = default;
+        source_concept& operator=(const source_concept&) = default;
+        source_concept& operator=(source_concept&&) = default;
+        virtual ~source_concept() = default;
+
+        virtual const slice_data
+        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const = 0;
+
+        virtual std::size_t size() const = 0;
+
+        virtual void
+        advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const = 0;
+
+        virtual void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const = 0;
+
+        virtual void slice_many(gsl::span<const byte_range> ranges,
+                                gsl::span<slice_data> out) const = 0;
+
+        virtual std::vector<memory_view>
+        segments(std::ptrdiff_t begin, std::ptrdiff_t end) const = 0;
+
+        virtual std::size_t alignment() const = 0;
+    };
+
+    template<typename source_type>
+    class model : public source_concept {
+    public:
+        explicit model(source_type source) : source_(std::move(source)) {}
+
+        virtual const slice_data
+        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const override
+        {
+            MEMORY_VIEW_TRACE(slices, 1);
+            return source_.slice(begin, end);
+        }
+
+        std::size_t size() const override { return source_.size(); }
+
+        void advise(std::ptrdiff_t begin,
+                    std::ptrdiff_t end,
+                    access_hint hint) const override
+        {
+            if constexpr (detail::has_advise<source_type>::value) {
+                source_.advise(begin, end, hint);
+            }
+        }
+
+        void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const override
+        {
+            detail::prefetch(source_, begin, end);
+        }
+
+        void slice_many(gsl::span<const byte_range> ranges,
+                        gsl::span<slice_data> out) const override
+        {
+            MEMORY_VIEW_TRACE(slices, ranges.size());
+            if constexpr (detail::has_slice_many<source_type>::value) {
+                source_.slice_many(ranges, out);
+            } else {
+                for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+                    out[idx] = source_.slice(ranges[idx].begin, ranges[idx].end);
+                }
+            }
+        }
+
+        std::vector<memory_view>
+        segments(std::ptrdiff_t begin, std::ptrdiff_t end) const override
+        {
+            if constexpr (detail::has_segments<source_type>::value) {
+                return source_.segments(begin, end);
+            } else {
+                return {};
+            }
+        }
+
+        std::size_t alignment() const override
+        {
+            return detail::alignment(source_);
+        }
+
+    private:
+        source_type source_;
+    };
+
+    /// Fetch state shared by all copies of a synchronized view, and by all
+    /// views derived from a grouped one.
+    /// Once `done` is set, `slice` is never modified again.
+    struct fetch_state {
+        fetch_state(std::ptrdiff_t begin, std::ptrdiff_t end, bool group)
+            : begin(begin), end(end), group(group)
+        {}
+
+        std::once_flag once;
+        std::atomic<bool> done{false};
+        slice_data slice = {nullptr, nullptr};
+        /// The fetched range, which contains the ranges of all views
+        /// sharing this state.
+        std::ptrdiff_t begin;
+        std::ptrdiff_t end;
+        bool group;
+    };
+
+    memory_view subview(std::ptrdiff_t first, std::ptrdiff_t last) const
+    {
+        memory_view copy = *this;
+        copy.begin_ = begin_ + first;
+        copy.end_ = begin_ + last;
+        if (fetch_ != nullptr && !fetch_->group) {
+            copy.fetch_ = std::make_shared<fetch_state>(copy.begin_, copy.end_, false);
+            if (slice_.ptr == nullptr
+                && fetch_->done.load(std::memory_order_acquire)) {
+                copy.slice_ = fetch_->slice;
+            }
+        }
+        if (copy.slice_.ptr != nullptr) {
+            std::advance(copy.slice_.ptr, first);
+        }
+        return copy;
+    }
+
+    const char* ptr() const
+    {
+        if (slice_.ptr != nullptr || self_ == nullptr) { return slice_.ptr; }
+        if (fetch_ == nullptr) {
+            slice_ = self_->slice(begin_, end_);
+            return slice_.ptr;
+        }
+        std::call_once(fetch_->once, [this]() {
+            fetch_->slice = self_->slice(fetch_->begin, fetch_->end);
+            fetch_->done.store(true, std::memory_order_release);
+        });
+        if (fetch_->slice.ptr == nullptr) { return nullptr; }
+        return std::next(fetch_->slice.ptr, begin_ - fetch_->begin);
+    }
+
+    std::size_t source_alignment() const
+    {
+        return self_ != nullptr ? self_->alignment() : 1;
+    }
+
+    std::shared_ptr<source_concept> self_ = nullptr;
+    std::ptrdiff_t begin_ = 0;
+    std::ptrdiff_t end_ = 0;
+    mutable slice_data slice_ = {nullptr, nullptr};
+    std::shared_ptr<fetch_state> fetch_ = nullptr;
+};
+
+/// A memory view over a source whose type is known at compile time.
+///
+/// It offers the same data access and slicing as `memory_view`, but calls
+/// the source directly instead of through virtual functions, so fetches
+/// can be inlined. It converts to a type-erased `memory_view` of the same
+/// range when needed.
+template<typename Source>
+class basic_memory_view : public detail::view_interface<basic_memory_view<Source>> {
+public:
+    explicit basic_memory_view(Source source)
+        : source_(std::move(source)), begin_(0), end_(source_.size())
+    {
+        if constexpr (detail::is_borrowed<Source>::value) {
+            slice_ = source_.slice(begin_, end_);
+        }
+    }
+
+    basic_memory_view() = default;
+    ~basic_memory_view() = default;
+    basic_memory_view(const basic_memory_view&) = default;
+    basic_memory_view(basic_memory_view&&) noexcept = default;
+    basic_memory_view& operator=(const basic_memory_view&) = default;
+    basic_memory_view& operator=(basic_memory_view&&) noexcept = default;
+
+    /// See `memory_view::advise()`.
+    void advise(access_hint hint) const
+    {
+        if constexpr (detail::has_advise<Source>::value) {
+            source_.advise(begin_, end_, hint);
+        }
+    }
+
+    /// See `memory_view::prefetch()`.
+    void prefetch() const
+    {
+        if (slice_.ptr == nullptr) {
+            detail::prefetch(source_, begin_, end_);
+        }
+    }
+
+    const Source& source() const { return source_; }
+
+    /// Returns a type-erased view of the same range.
+    /// Data that has already been fetched is not fetched again.
+    /// The type-erased source is created on the first conversion and shared
+    /// by later conversions of this view and of views sliced from it then.
+    operator memory_view() const
+    {
+        if constexpr (detail::is_borrowed<Source>::value) {
+            return memory_view(source_)(begin_, end_);
+        } else {
+            if (erased_ == nullptr) { erased_ = memory_view(source_).self_; }
+            memory_view view;
+            view.self_ = erased_;
+            view.begin_ = begin_;
+            view.end_ = end_;
+            view.slice_ = slice_;
+            return view;
+        }
+    }
+
+private:
+    friend class detail::view_interface<basic_memory_view>;
+
+    basic_memory_view subview(std::ptrdiff_t first, std::ptrdiff_t last) const
+    {
+        basic_memory_view copy = *this;
+        copy.begin_ = begin_ + first;
+        copy.end_ = begin_ + last;
+        if (copy.slice_.ptr != nullptr) {
+            std::advance(copy.slice_.ptr, first);
+        }
+        return copy;
+    }
+
+    const char* ptr() const
+    {
+        if (slice_.ptr == nullptr) {
+            slice_ = source_.slice(begin_, end_);
+        }
+        return slice_.ptr;
+    }
+
+    std::size_t source_alignment() const { return detail::alignment(source_); }
+
+    Source source_{};
+    std::ptrdiff_t begin_ = 0;
+    std::ptrdiff_t end_ = 0;
+    mutable slice_data slice_ = {nullptr, nullptr};
+    mutable std::shared_ptr<memory_view::source_concept> erased_ = nullptr;
+};
+
+/// A view to writable memory, such as a growable buffer or a memory mapped
+/// output file.
+///
+/// It offers the same data access and slicing as `memory_view`, and on top
+/// of that, typed writes mirroring the reads. Like a span, it does not own
+/// the data, so writes are allowed through a const view.
+/// It converts to a read-only `memory_view` of the same data.
+class mutable_memory_view : public detail::view_interface<mutable_memory_view> {
+public:
+    /// Creates a view from a writable memory source.
+    ///
+    /// \tparam source_type
+    ///
+    /// This type must provide the following methods:
+    /// ```
+    /// const mutable_slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const;
+    /// std::size_t size() const;
+    /// ```
+    /// Optionally, it can also provide:
+    /// ```
+    /// void flush(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode) const;
+    /// std::size_t alignment() const;
+    /// ```
+    /// Writes through a slice must be visible to later slices of the same
+    /// range, at the latest after the first slice is released or flushed.
+    template<typename source_type,
+             typename = std::enable_if_t<
+                 detail::is_source<source_type, mutable_slice_data>::value>>
+    mutable_memory_view(source_type source)
+        : self_(std::make_shared<model<source_type>>(std::move(source))),
+          begin_(0),
+          end_(self_->size())
+    {}
+
+    mutable_memory_view() = default;
+    ~mutable_memory_view() = default;
+    mutable_memory_view(const mutable_memory_view&) = default;
+    mutable_memory_view(mutable_memory_view&&) noexcept = default;
+    mutable_memory_view& operator=(const mutable_memory_view&) = default;
+    mutable_memory_view& operator=(mutable_memory_view&&) noexcept = default;
+
+    /// Returns a writable pointer to the beginning of the data.
+    char* as_writable_ptr() const { return writable_ptr(); }
+
+    /// Returns a writable span of the given type.
+    ///
+    /// The data must be aligned for `T`, which `is_aligned()` tells, as
+    /// for `as_span()`.
+    template<typename T>
+    gsl::span<T> as_writable_span() const
+    {
+        char* ptr = writable_ptr();
+        assert(reinterpret_cast<std::uintptr_t>(ptr) % alignof(T) == 0
+               && "as_writable_span: data not aligned");
+        return gsl::span<T>(reinterpret_cast<T*>(ptr), size() / sizeof(T));
+    }
+
+    /// Writes a value at the beginning of the range; see `as()`.
+    template<typename T>
+    void store(const detail::untagged_t<T>& value) const
+    {
+        detail::store<detail::untagged_t<T>, detail::byte_order<T>::order>(
+            writable_ptr(), value);
+    }
+
+    /// Writes several values one after another, without any padding;
+    /// see `unpack()`.
+    ///
+    /// Example:
+    /// ```
+    /// view.pack<std::uint32_t, mv::be<std::uint16_t>>(n, flags);
+    /// ```
+    template<typename... T>
+    void pack(const detail::untagged_t<T>&... values) const
+    {
+        packed_layout<T...>::encode(writable_ptr(), values...);
+    }
+
+    /// Writes leading values, as `pack()` does, and returns the remaining
+    /// slice; see `unpack_head()`.
+    template<typename... T>
+    mutable_memory_view pack_head(const detail::untagged_t<T>&... values) const
+    {
+        pack<T...>(values...);
+        return subview(static_cast<std::ptrdiff_t>(packed_layout<T...>::size), end_ - begin_);
+    }
+
+    /// Writes a record described by `Layout`; see `decode()`.
+    template<typename Layout, typename... T>
+    void encode(const T&... values) const
+    {
+        Layout::encode(writable_ptr(), values...);
+    }
+
+    /// Asks the source to write the viewed range to its storage,
+    /// e.g., with `msync` for a memory mapped file.
+    /// Sources without any backing storage ignore it.
+    void flush(flush_mode mode = flush_mode::sync) const
+    {
+        if (self_ != nullptr) {
+            self_->flush(begin_, end_, mode);
+        }
+    }
+
+    /// Returns a read-only view of the same data, which keeps it alive.
+    operator memory_view() const;
+
+private:
+    friend class detail::view_interface<mutable_memory_view>;
+    friend struct detail::mutable_view_source;
+
+    struct source_concept {
+        source_concept() = default;
+        source_concept(const source_concept&) = default;
+        source_concept(source_concept&&) = default;
+        source_concept& operator=(const source_concept&) = default;
+        source_concept& operator=(source_concept&&) = default;
+        virtual ~source_concept() = default;
+
+        virtual const mutable_slice_data
+        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const = 0;
+
+        virtual std::size_t size() const = 0;
+
+        virtual void
+        flush(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode) const = 0;
+
+        virtual std::size_t alignment() const = 0;
+    };
+
+    template<typename source_type>
+    class model : public source_concept {
+    public:
+        explicit model(source_type source) : source_(std::move(source)) {}
+
+        const mutable_slice_data
+        slice(std::ptrdiff_t begin, std::ptrdiff_t end) const override
+        {
+            MEMORY_VIEW_TRACE(slices, 1);
+            return source_.slice(begin, end);
+        }
+
+        std::size_t size() const override { return source_.size(); }
+
+        void flush(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode) const override
+        {
+            if constexpr (detail::has_flush<source_type>::value) {
+                source_.flush(begin, end, mode);
+            }
+        }
+
+        std::size_t alignment() const override
+        {
+            return detail::alignment(source_);
+        }
+
+    private:
+        source_type source_;
+    };
+
+    mutable_memory_view subview(std::ptrdiff_t first, std::ptrdiff_t last) const
+    {
+        mutable_memory_view copy = *this;
+        copy.begin_ = begin_ + first;
+        copy.end_ = begin_ + last;
+        if (copy.slice_.ptr != nullptr) {
+            std::advance(copy.slice_.ptr, first);
+        }
+        return copy;
+    }
+
+    char* writable_ptr() const
+    {
+        if (slice_.ptr == nullptr && self_ != nullptr) {
+            slice_ = self_->slice(begin_, end_);
+        }
+        return slice_.ptr;
+    }
+
+    const char* ptr() const { return writable_ptr(); }
+
+    std::size_t source_alignment() const
+    {
+        return self_ != nullptr ? self_->alignment() : 1;
+    }
+
+    std::shared_ptr<source_concept> self_ = nullptr;
+    std::ptrdiff_t begin_ = 0;
+    std::ptrdiff_t end_ = 0;
+    mutable mutable_slice_data slice_ = {nullptr, nullptr};
+};
+
+namespace detail {
+
+/// Read-only source over the data of a `mutable_memory_view`.
+struct mutable_view_source {
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        char* ptr = view.writable_ptr();
+        return {ptr == nullptr ? nullptr : std::next(ptr, begin), view.slice_.handler};
+    }
+    std::size_t size() const { return view.size(); }
+    std::size_t alignment() const
+    {
+        return std::gcd(view.source_alignment(), static_cast<std::size_t>(view.begin_));
+    }
+
+    mutable_memory_view view;
+};
+
+/// Writable source over a part of a pooled buffer.
+struct pooled_buffer_source {
+    const mutable_slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return {std::next(handler->data(), offset + begin), handler};
+    }
+    std::size_t size() const { return length; }
+
+    std::shared_ptr<pooled_handler> handler;
+    std::ptrdiff_t offset;
+    std::size_t length;
+};
+
+}  // namespace detail
+
+inline mutable_memory_view::operator memory_view() const
+{
+    // Resolved once here, so that the shared copy is never modified.
+    writable_ptr();
+    return memory_view(detail::mutable_view_source{*this});
+}
+
+/// Memory source based on an existing contiguous memory area.
+/// **Warning**: any data passed to the constructors must be valid for the
+///              entire lifetime of the memory source. It must be enforced
+///              by the user. In the future, this will be deprecated in
+///              favor of a lifetime-aware solution (although most likely
+///              this will still be available to use with a warning in place).
+class ptr_memory_source {
+public:
+    static constexpr bool borrowed = true;
+
+    ptr_memory_source(const char* ptr, std::size_t size)
+        : ptr_(ptr), len_(size) {}
+
+    template<int size>
+    ptr_memory_source(const std::array<char, size>& arr)
+        : ptr_(&arr[0]), len_(arr.size()) {}
+
+    template<typename ContiguousContainer>
+    ptr_memory_source(const ContiguousContainer& container)
+        : ptr_(&container[0]), len_(container.size()) {}
+
+    ptr_memory_source() = default;
+    ~ptr_memory_source() = default;
+    ptr_memory_source(const ptr_memory_source&) = default;
+    ptr_memory_source(ptr_memory_source&) = default;
+    ptr_memory_source& operator=(const ptr_memory_source&) = default;
+    ptr_memory_source& operator=(ptr_memory_source&&) = default;
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return {std::next(ptr_, begin), nullptr};
+    }
+    std::size_t size() const { return len_; }
+
+private:
+    const char* ptr_ = nullptr;
+    std::size_t len_ = 0;
+};
+
+/// Memory source based on an input stream.
+/// Each data access reads from the stream.
+class istream_memory_source {
+public:
+    /// Slices seek the shared stream, so they must not run concurrently.
+    static constexpr bool thread_safe = false;
+
+    istream_memory_source(std::istream& stream, std::size_t size)
+        : stream_(stream), size_(size)
+    {}
+
+    istream_memory_source() = default;
+    ~istream_memory_source() = default;
+    istream_memory_source(const istream_memory_source&) = default;
+    istream_memory_source(istream_memory_source&) = default;
+    istream_memory_source& operator=(const istream_memory_source&) = default;
+    istream_memory_source& operator=(istream_memory_source&&) = default;
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return {nullptr, nullptr}; }
+        auto buffer = detail::pooled_slice::make(begin, end);
+        stream_.seekg(begin);
+        stream_.read(buffer.data, end - begin);
+        return buffer;
+    }
+    /// Fetches all `ranges`, reading overlapping and adjacent ones at once.
+    void slice_many(gsl::span<const byte_range> ranges,
+                    gsl::span<slice_data> out) const
+    {
+        detail::coalesced_slice_many(ranges, out, 0, [this](auto merged, auto fetched) {
+            for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(merged.size()); ++idx) {
+                fetched[idx] = slice(merged[idx].begin, merged[idx].end);
+            }
+        });
+    }
+    std::size_t size() const { return size_; }
+    std::size_t alignment() const { return buffer_pool::alignment; }
+
+private:
+    std::istream& stream_;
+    std::size_t size_ = 0u;
+};
+
+#ifdef MEMORY_VIEW_POSIX
+
+/// Owns a read-only memory mapping, which is unmapped once the last
+/// slice referencing it goes out of scope.
+class mmap_handler : public base_handler {
+public:
+    mmap_handler(void* addr, std::size_t length) : addr_(addr), length_(length)
+    {}
+
+    mmap_handler() = delete;
+    mmap_handler(const mmap_handler&) = delete;
+    mmap_handler(mmap_handler&&) = delete;
+    mmap_handler& operator=(const mmap_handler&) = delete;
+    mmap_handler& operator=(mmap_handler&&) = delete;
+    ~mmap_handler()
+    {
+        if (addr_ != nullptr) {
+            munmap(addr_, length_);
+        }
+    }
+
+    const char* data() const { return static_cast<const char*>(addr_); }
+    std::size_t size() const { return length_; }
+
+    /// Calls `madvise` on the pages overlapping `[begin, end)`.
+    /// Failures are ignored, since the advice is not binding anyway.
+    void advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+    {
+        if (addr_ == nullptr || begin >= end) { return; }
+        auto page = static_cast<std::ptrdiff_t>(sysconf(_SC_PAGESIZE));
+        auto first = begin - begin % page;
+        auto* addr = static_cast<char*>(addr_) + first;
+        madvise(addr, end - first, advice(hint));
+    }
+
+private:
+    static int advice(access_hint hint)
+    {
+        switch (hint) {
+        case access_hint::sequential: return MADV_SEQUENTIAL;
+        case access_hint::random: return MADV_RANDOM;
+        case access_hint::willneed: return MADV_WILLNEED;
+#ifdef MADV_HUGEPAGE
+        case access_hint::hugepages: return MADV_HUGEPAGE;
+#endif
+        default: return MADV_NORMAL;
+        }
+    }
+
+    void* addr_ = nullptr;
+    std::size_t length_ = 0;
+};
+
+/// Memory source based on a read-only memory mapped file.
+///
+/// The mapping is owned by an `mmap_handler` shared by the source and all
+/// slices fetched from it, so views remain valid even after the source
+/// itself is destroyed. Slicing never copies.
+class mmap_memory_source {
+public:
+    /// Maps the entire file at `path`.
+    ///
+    /// \param hint    Access hint applied to the whole mapping.
+    /// \throws std::system_error if the file cannot be opened or mapped.
+    explicit mmap_memory_source(const std::string& path,
+                                access_hint hint = access_hint::normal)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) { fail(path); }
+        struct stat st {};
+        if (fstat(fd, &st) < 0) {
+            fail(path, fd);
+        }
+        auto length = static_cast<std::size_t>(st.st_size);
+        void* addr = nullptr;
+        if (length > 0) {
+            addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                fail(path, fd);
+            }
+        }
+        close(fd);
+        mapping_ = std::make_shared<mmap_handler>(addr, length);
+        if (hint != access_hint::normal) {
+            mapping_->advise(0, length, hint);
+        }
+    }
+
+    mmap_memory_source() = default;
+    ~mmap_memory_source() = default;
+    mmap_memory_source(const mmap_memory_source&) = default;
+    mmap_memory_source(mmap_memory_source&&) = default;
+    mmap_memory_source& operator=(const mmap_memory_source&) = default;
+    mmap_memory_source& operator=(mmap_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (mapping_ == nullptr) { return {nullptr, nullptr}; }
+        return {std::next(mapping_->data(), begin), mapping_};
+    }
+    std::size_t size() const { return mapping_ == nullptr ? 0 : mapping_->size(); }
+    /// Mappings start at a page boundary.
+    std::size_t alignment() const
+    {
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+    void advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+    {
+        if (mapping_ != nullptr) { mapping_->advise(begin, end, hint); }
+    }
+
+private:
+    /// Closes `fd`, if open, without clobbering `errno`, and throws.
+    [[noreturn]] static void fail(const std::string& path, int fd = -1)
+    {
+        auto error = errno;
+        if (fd >= 0) { close(fd); }
+        throw std::system_error(
+            error, std::generic_category(), "mmap_memory_source: " + path);
+    }
+
+    std::shared_ptr<mmap_handler> mapping_ = nullptr;
+};
+
+/// Writable memory source based on a shared memory mapping of a file.
+///
+/// Writes go directly to the page cache; `mutable_memory_view::flush()`
+/// calls `msync` on the pages of the view, and otherwise, the kernel writes
+/// them back on its own schedule. The mapping stays valid as long as any
+/// view of it exists.
+class mutable_mmap_source {
+public:
+    /// Maps the file at `path` for writing, creating it if it does not exist
+    /// and resizing it to `size` bytes.
+    ///
+    /// \throws std::system_error if the file cannot be opened, resized,
+    ///         or mapped.
+    mutable_mmap_source(const std::string& path, std::size_t size)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) { fail(path); }
+        if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+            fail(path, fd);
+        }
+        void* addr = nullptr;
+        if (size > 0) {
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                fail(path, fd);
+            }
+        }
+        close(fd);
+        data_ = static_cast<char*>(addr);
+        mapping_ = std::make_shared<mmap_handler>(addr, size);
+    }
+
+    mutable_mmap_source() = default;
+    ~mutable_mmap_source() = default;
+    mutable_mmap_source(const mutable_mmap_source&) = default;
+    mutable_mmap_source(mutable_mmap_source&&) = default;
+    mutable_mmap_source& operator=(const mutable_mmap_source&) = default;
+    mutable_mmap_source& operator=(mutable_mmap_source&&) = default;
+
+    const mutable_slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (mapping_ == nullptr) { return {nullptr, nullptr}; }
+        return {std::next(data_, begin), mapping_};
+    }
+    std::size_t size() const { return mapping_ == nullptr ? 0 : mapping_->size(); }
+    std::size_t alignment() const
+    {
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    /// Calls `msync` on the pages overlapping `[begin, end)`.
+    ///
+    /// \throws std::system_error if `msync` fails.
+    void flush(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode) const
+    {
+        if (data_ == nullptr || begin >= end) { return; }
+        auto page = static_cast<std::ptrdiff_t>(sysconf(_SC_PAGESIZE));
+        auto first = begin - begin % page;
+        int flags = mode == flush_mode::sync ? MS_SYNC : MS_ASYNC;
+        if (msync(std::next(data_, first), end - first, flags) < 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+private:
+    /// Closes `fd`, if open, without clobbering `errno`, and throws.
+    [[noreturn]] static void fail(const std::string& path, int fd = -1)
+    {
+        auto error = errno;
+        if (fd >= 0) { close(fd); }
+        throw std::system_error(
+            error, std::generic_category(), "mutable_mmap_source: " + path);
+    }
+
+    char* data_ = nullptr;
+    std::shared_ptr<mmap_handler> mapping_ = nullptr;
+};
+
+/// Which pages back the memory of a `numa_memory_source`.
+enum class page_kind {
+    /// Regular pages.
+    normal,
+    /// Regular pages, which the kernel may merge into transparent huge pages.
+    transparent_huge,
+    /// Pages from the preallocated huge page pool (`MAP_HUGETLB`).
+    explicit_huge
+};
+
+/// How the memory of a `numa_memory_source` is placed on NUMA nodes.
+enum class numa_placement {
+    /// Each page is placed on the node of the thread that copies it.
+    first_touch,
+    /// Pages are spread evenly across all nodes.
+    interleave,
+    /// Each node gets a full copy of the data.
+    replicate
+};
+
+namespace detail {
+
+/// \returns The online NUMA nodes, or only node 0 if they are not known.
+inline std::vector<int> numa_nodes()
+{
+    std::vector<int> nodes;
+    std::ifstream in("/sys/devices/system/node/online");
+    int first = 0;
+    while (in >> first) {
+        int last = first;
+        if (in.peek() == '-') {
+            in.get();
+            in >> last;
+        }
+        for (int node = first; node <= last; ++node) { nodes.push_back(node); }
+        if (in.peek() == ',') { in.get(); }
+    }
+    if (nodes.empty()) { nodes.push_back(0); }
+    return nodes;
+}
+
+/// \returns The NUMA node of the CPU running the calling thread.
+inline int current_numa_node()
+{
+#ifdef MEMORY_VIEW_NUMA
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) { return static_cast<int>(node); }
+#endif
+    return 0;
+}
+
+/// The size of a huge page assumed for alignment.
+constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+inline std::size_t round_up(std::size_t value, std::size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/// \returns The length of the mapping made by `map_anonymous` for `size`
+///          bytes of `pages`.
+inline std::size_t anonymous_length(std::size_t size, page_kind pages)
+{
+    return round_up(size, pages == page_kind::normal
+                              ? static_cast<std::size_t>(sysconf(_SC_PAGESIZE))
+                              : huge_page_size);
+}
+
+/// Maps private anonymous memory for `size` bytes, aligned to a huge page
+/// unless regular pages are used. Falls back to transparent huge pages,
+/// and updates `pages` accordingly, if explicit ones are not available.
+///
+/// \returns The mapped memory, or `nullptr` if `size` is zero.
+/// \throws std::system_error if the memory cannot be mapped.
+inline char* map_anonymous(std::size_t size, page_kind& pages)
+{
+    if (size == 0) { return nullptr; }
+#ifdef MAP_HUGETLB
+    if (pages == page_kind::explicit_huge) {
+        void* addr = mmap(nullptr, anonymous_length(size, pages), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) { return static_cast<char*>(addr); }
+    }
+#endif
+    if (pages == page_kind::explicit_huge) { pages = page_kind::transparent_huge; }
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto alignment = pages == page_kind::normal ? page : huge_page_size;
+    auto length = anonymous_length(size, pages);
+    // Over-allocate to trim the mapping to an aligned address.
+    auto reserved = length + alignment - page;
+    void* addr = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    auto* base = static_cast<char*>(addr);
+    auto offset = round_up(reinterpret_cast<std::uintptr_t>(base), alignment)
+        - reinterpret_cast<std::uintptr_t>(base);
+    if (offset > 0) { munmap(base, offset); }
+    if (reserved - offset > length) {
+        munmap(base + offset + length, reserved - offset - length);
+    }
+#ifdef MADV_HUGEPAGE
+    if (pages == page_kind::transparent_huge) {
+        madvise(base + offset, length, MADV_HUGEPAGE);
+    }
+#endif
+    return base + offset;
+}
+
+/// Owns anonymous memory mappings, which are unmapped once the last slice
+/// referencing them goes out of scope.
+class anonymous_mapping_handler : public base_handler {
+public:
+    anonymous_mapping_handler() = default;
+    anonymous_mapping_handler(const anonymous_mapping_handler&) = delete;
+    anonymous_mapping_handler(anonymous_mapping_handler&&) = delete;
+    anonymous_mapping_handler& operator=(const anonymous_mapping_handler&) = delete;
+    anonymous_mapping_handler& operator=(anonymous_mapping_handler&&) = delete;
+    ~anonymous_mapping_handler()
+    {
+        for (const auto& [addr, length] : mappings) { munmap(addr, length); }
+    }
+
+    std::vector<std::pair<char*, std::size_t>> mappings;
+};
+
+/// Binds the not yet touched `length` bytes at `addr` to `nodes`: to the
+/// only node, or interleaved if there are several.
+///
+/// \returns Whether the policy was applied; failures are not otherwise
+///          reported, since placement only affects performance.
+inline bool bind_to_nodes([[maybe_unused]] char* addr,
+                          [[maybe_unused]] std::size_t length,
+                          [[maybe_unused]] const std::vector<int>& nodes)
+{
+#if defined(MEMORY_VIEW_NUMA) && defined(SYS_mbind)
+    if (addr == nullptr || nodes.empty()) { return false; }
+    constexpr std::size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(nodes.back() / bits + 1, 0);
+    for (int node : nodes) { mask[node / bits] |= 1ul << (node % bits); }
+    int mode = nodes.size() == 1 ? MPOL_BIND : MPOL_INTERLEAVE;
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return syscall(SYS_mbind, addr, round_up(length, page), mode, mask.data(),
+                   mask.size() * bits + 1, 0)
+        == 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace detail
+
+/// Owning in-memory source, backed by huge pages and placed explicitly on
+/// NUMA nodes, for data that is probed at random.
+///
+/// With `numa_placement::replicate`, each node holds its own copy, and
+/// every slice points into the copy on the node of the thread fetching it,
+/// so a view should be sliced by the threads that then access it.
+/// Placement is a best effort: if the kernel does not support NUMA
+/// policies, the data is left where it is first touched, which `bound()`
+/// reports per copy, and if no preallocated huge pages are available,
+/// transparent ones are used.
+class numa_memory_source {
+public:
+    /// The size of a huge page assumed for alignment.
+    static constexpr std::size_t huge_page_size = detail::huge_page_size;
+
+    /// Copies the data of `data` into newly allocated memory.
+    ///
+    /// \throws std::system_error if the memory cannot be allocated.
+    explicit numa_memory_source(const memory_view& data,
+                                numa_placement placement = numa_placement::first_touch,
+                                page_kind pages = page_kind::transparent_huge)
+        : state_(std::make_shared<detail::anonymous_mapping_handler>()),
+          pages_(pages),
+          size_(data.size())
+    {
+        auto nodes = detail::numa_nodes();
+        std::vector<std::vector<int>> groups;
+        if (placement == numa_placement::replicate) {
+            for (int node : nodes) { groups.push_back({node}); }
+        } else {
+            groups.push_back(placement == numa_placement::interleave ? nodes
+                                                                     : std::vector<int>{});
+        }
+        replica_of_node_.assign(nodes.back() + 1, 0);
+        for (std::size_t idx = 0; idx < groups.size(); ++idx) {
+            char* replica = allocate();
+            bound_.push_back(!groups[idx].empty()
+                             && detail::bind_to_nodes(replica, size_, groups[idx]));
+            if (size_ > 0) {
+                std::memcpy(replica, data.as_ptr(), size_);
+            }
+            replicas_.push_back(replica);
+            if (placement == numa_placement::replicate) {
+                replica_of_node_[groups[idx].front()] = idx;
+            }
+        }
+    }
+
+    numa_memory_source() = default;
+    ~numa_memory_source() = default;
+    numa_memory_source(const numa_memory_source&) = default;
+    numa_memory_source(numa_memory_source&&) = default;
+    numa_memory_source& operator=(const numa_memory_source&) = default;
+    numa_memory_source& operator=(numa_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return {std::next(local_replica(), begin), state_};
+    }
+    std::size_t size() const { return size_; }
+    std::size_t alignment() const
+    {
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    /// \returns The number of copies of the data.
+    std::size_t replicas() const { return replicas_.size(); }
+
+    /// \returns The kind of pages actually used, which is `transparent_huge`
+    ///          if `explicit_huge` was requested but not available.
+    page_kind pages() const { return pages_; }
+
+    /// \returns Whether copy `replica` was bound to its NUMA nodes. This is
+    ///          always false for `first_touch`, and false for the other
+    ///          placements if the kernel rejected the policy, in which case
+    ///          the copy is left where it was first touched.
+    bool bound(std::size_t replica) const
+    {
+        return replica < bound_.size() && bound_[replica];
+    }
+
+private:
+    char* local_replica() const
+    {
+        if (replicas_.empty()) { return nullptr; }
+        if (replicas_.size() == 1) { return replicas_.front(); }
+        auto node = static_cast<std::size_t>(detail::current_numa_node());
+        return replicas_[node < replica_of_node_.size() ? replica_of_node_[node] : 0];
+    }
+
+    char* allocate()
+    {
+        auto* replica = detail::map_anonymous(size_, pages_);
+        if (replica != nullptr) {
+            state_->mappings.emplace_back(replica, detail::anonymous_length(size_, pages_));
+        }
+        return replica;
+    }
+
+    std::shared_ptr<detail::anonymous_mapping_handler> state_ = nullptr;
+    std::vector<char*> replicas_{};
+    std::vector<std::size_t> replica_of_node_{};
+    std::vector<bool> bound_{};
+    page_kind pages_ = page_kind::normal;
+    std::size_t size_ = 0;
+};
+
+namespace detail {
+
+/// Writes exactly `length` bytes at `offset`, retrying short writes.
+inline void pwrite_all(int fd, const char* data, std::size_t length, off_t offset)
+{
+    while (length > 0) {
+        auto count = ::pwrite(fd, data, length, offset);
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            throw std::system_error(errno, std::generic_category(), "pwrite");
+        }
+        data += count;
+        length -= count;
+        offset += count;
+    }
+}
+
+/// Reads exactly `length` bytes at `offset`, retrying short reads.
+inline void pread_all(int fd, char* out, std::size_t length, off_t offset)
+{
+    while (length > 0) {
+        auto count = ::pread(fd, out, length, offset);
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            throw std::system_error(errno, std::generic_category(), "pread");
+        }
+        if (count == 0) {
+            throw std::system_error(
+                std::make_error_code(std::errc::io_error),
+                "pread: unexpected end of file");
+        }
+        out += count;
+        length -= count;
+        offset += count;
+    }
+}
+
+#ifdef MEMORY_VIEW_IO_URING
+
+/// A minimal io_uring instance used to submit batches of reads.
+///
+/// Talks to the kernel directly through `io_uring_setup` and
+/// `io_uring_enter`, so no liburing is required.
+class io_uring_queue {
+public:
+    struct read_request {
+        char* buffer;
+        std::size_t length;
+        off_t offset;
+        int result;
+    };
+
+    /// \throws std::system_error if io_uring is not available.
+    explicit io_uring_queue(unsigned entries)
+    {
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) { fail("io_uring_setup"); }
+        entries_ = params.sq_entries;
+        sq_off_ = params.sq_off;
+        cq_off_ = params.cq_off;
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes
+            + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+        cq_ = single_mmap ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    }
+
+    io_uring_queue() = delete;
+    io_uring_queue(const io_uring_queue&) = delete;
+    io_uring_queue(io_uring_queue&&) = delete;
+    io_uring_queue& operator=(const io_uring_queue&) = delete;
+    io_uring_queue& operator=(io_uring_queue&&) = delete;
+    ~io_uring_queue() { release(); }
+
+    /// Reads all `requests` from `fd`, keeping up to the queue depth of
+    /// them in flight: a new read is queued as soon as one completes.
+    /// Sets `result` of each request to the number of bytes read or to a
+    /// negated `errno` value.
+    ///
+    /// \throws std::system_error if `io_uring_enter` fails. All reads
+    ///         submitted before the failure have completed by then, and the
+    ///         queue stays usable.
+    void read(int fd, gsl::span<read_request> requests)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsigned mask = *sq_field(sq_off_.ring_mask);
+        unsigned* array = sq_field(sq_off_.array);
+        auto count = static_cast<std::ptrdiff_t>(requests.size());
+        std::ptrdiff_t next = 0;
+        unsigned queued = 0;
+        unsigned in_flight = 0;
+        while (next < count || queued + in_flight > 0) {
+            unsigned tail = *sq_field(sq_off_.tail);
+            for (; next < count && queued + in_flight < entries_; ++next, ++queued) {
+                auto& request = requests[next];
+                unsigned slot = tail++ & mask;
+                io_uring_sqe& sqe = sqes_[slot];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<std::uint64_t>(request.buffer);
+                sqe.len = static_cast<std::uint32_t>(
+                    std::min<std::size_t>(request.length, 1u << 30));
+                sqe.off = static_cast<std::uint64_t>(request.offset);
+                sqe.user_data = static_cast<std::uint64_t>(next);
+                array[slot] = slot;
+            }
+            __atomic_store_n(sq_field(sq_off_.tail), tail, __ATOMIC_RELEASE);
+            auto submitted = enter(queued, 1);
+            if (submitted < 0) {
+                if (errno == EINTR) { continue; }
+                int error = errno;
+                // Take back the reads the kernel has not consumed, and wait
+                // for the others, which still write into the buffers.
+                __atomic_store_n(sq_field(sq_off_.tail),
+                                 __atomic_load_n(sq_field(sq_off_.head), __ATOMIC_ACQUIRE),
+                                 __ATOMIC_RELEASE);
+                drain(in_flight, requests);
+                throw std::system_error(error, std::generic_category(), "io_uring_enter");
+            }
+            queued -= static_cast<unsigned>(submitted);
+            in_flight += static_cast<unsigned>(submitted);
+            in_flight -= reap(requests);
+        }
+    }
+
+private:
+    long enter(unsigned to_submit, unsigned min_complete)
+    {
+        return syscall(__NR_io_uring_enter,
+                       fd_,
+                       to_submit,
+                       min_complete,
+                       IORING_ENTER_GETEVENTS,
+                       nullptr,
+                       0);
+    }
+
+    /// Waits for `in_flight` submitted reads to complete.
+    void drain(unsigned in_flight, gsl::span<read_request> requests)
+    {
+        while (in_flight > 0) {
+            if (enter(0, in_flight) < 0 && errno != EINTR) {
+                // The kernel may still write into buffers that are about
+                // to be released, and there is no way to wait for it.
+                std::terminate();
+            }
+            in_flight -= reap(requests);
+        }
+    }
+
+    unsigned reap(gsl::span<read_request> requests)
+    {
+        unsigned* head_ptr = cq_field(cq_off_.head);
+        unsigned head = *head_ptr;
+        unsigned tail = __atomic_load_n(cq_field(cq_off_.tail), __ATOMIC_ACQUIRE);
+        unsigned mask = *cq_field(cq_off_.ring_mask);
+        auto* cqes = reinterpret_cast<io_uring_cqe*>(
+            static_cast<char*>(cq_) + cq_off_.cqes);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes[head & mask];
+            requests[static_cast<std::ptrdiff_t>(cqe.user_data)].result = cqe.res;
+        }
+        __atomic_store_n(head_ptr, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    unsigned* sq_field(unsigned offset) const
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(sq_) + offset);
+    }
+
+    unsigned* cq_field(unsigned offset) const
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(cq_) + offset);
+    }
+
+    void* map(std::size_t length, off_t offset)
+    {
+        void* addr = mmap(nullptr,
+                          length,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          fd_,
+                          offset);
+        if (addr == MAP_FAILED) { fail("io_uring mmap"); }
+        return addr;
+    }
+
+    void release()
+    {
+        if (sqes_ != nullptr) { munmap(sqes_, sqes_size_); }
+        if (cq_ != nullptr && cq_ != sq_) { munmap(cq_, cq_size_); }
+        if (sq_ != nullptr) { munmap(sq_, sq_size_); }
+        if (fd_ >= 0) { close(fd_); }
+        sqes_ = nullptr;
+        cq_ = sq_ = nullptr;
+        fd_ = -1;
+    }
+
+    /// Used only while constructing the queue.
+    [[noreturn]] void fail(const char* what)
+    {
+        int error = errno;
+        release();
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    int fd_ = -1;
+    unsigned entries_ = 0;
+    io_sqring_offsets sq_off_{};
+    io_cqring_offsets cq_off_{};
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sq_size_ = 0;
+    std::size_t cq_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    std::mutex mutex_;
+};
+
+#endif
+
+}  // namespace detail
+
+/// I/O backend used by `file_memory_source` for batched reads.
+enum class io_mode { pread, io_uring };
+
+/// Memory source reading from a file through a raw file descriptor.
+///
+/// Each data access reads the requested range with `pread`. Since there is
+/// no shared seek position, a single source can be read from several
+/// threads at once. With `io_mode::io_uring`, the ranges passed to
+/// `slice_many` are submitted as one batch and read concurrently;
+/// if io_uring is not available, `pread` is used instead.
+class file_memory_source {
+public:
+    /// Opens the file at `path`.
+    ///
+    /// \param mode         Backend used for batched reads.
+    /// \param queue_depth  Maximum number of reads in flight with io_uring.
+    /// \throws std::system_error if the file cannot be opened.
+    explicit file_memory_source(const std::string& path,
+                                [[maybe_unused]] io_mode mode = io_mode::pread,
+                                [[maybe_unused]] unsigned queue_depth = 64)
+        : state_(std::make_shared<file_state>())
+    {
+        state_->fd = open(path.c_str(), O_RDONLY);
+        struct stat st {};
+        if (state_->fd < 0 || fstat(state_->fd, &st) < 0) {
+            throw std::system_error(
+                errno, std::generic_category(), "file_memory_source: " + path);
+        }
+        state_->size = static_cast<std::size_t>(st.st_size);
+#ifdef MEMORY_VIEW_IO_URING
+        if (mode == io_mode::io_uring) {
+            try {
+                state_->ring =
+                    std::make_unique<detail::io_uring_queue>(queue_depth);
+            } catch (const std::system_error&) {
+                state_->ring = nullptr;
+            }
+        }
+#endif
+    }
+
+    file_memory_source() = default;
+    ~file_memory_source() = default;
+    file_memory_source(const file_memory_source&) = default;
+    file_memory_source(file_memory_source&&) = default;
+    file_memory_source& operator=(const file_memory_source&) = default;
+    file_memory_source& operator=(file_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end || state_ == nullptr) { return {nullptr, nullptr}; }
+        auto buffer = detail::pooled_slice::make(begin, end);
+        detail::pread_all(state_->fd, buffer.data, end - begin, begin);
+        return buffer;
+    }
+
+    /// Fetches all `ranges` at once, writing the results to `out`.
+    /// Overlapping and adjacent ranges are merged and read only once.
+    void slice_many(gsl::span<const byte_range> ranges,
+                    gsl::span<slice_data> out) const
+    {
+        if (state_ == nullptr) {
+            std::fill(out.begin(), out.end(), slice_data{nullptr, nullptr});
+            return;
+        }
+        detail::coalesced_slice_many(ranges, out, 0, [this](auto merged, auto fetched) {
+            read_many(merged, fetched);
+        });
+    }
+
+    std::size_t size() const { return state_ == nullptr ? 0 : state_->size; }
+    std::size_t alignment() const { return buffer_pool::alignment; }
+
+    /// Forwards the hint to `posix_fadvise` where available.
+    void advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+    {
+#ifdef POSIX_FADV_WILLNEED
+        int advice = POSIX_FADV_NORMAL;
+        switch (hint) {
+        case access_hint::sequential: advice = POSIX_FADV_SEQUENTIAL; break;
+        case access_hint::random: advice = POSIX_FADV_RANDOM; break;
+        case access_hint::willneed: advice = POSIX_FADV_WILLNEED; break;
+        default: break;
+        }
+        if (state_ != nullptr) { posix_fadvise(state_->fd, begin, end - begin, advice); }
+#endif
+    }
+
+    /// Starts reading `[begin, end)` into the page cache.
+    void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        advise(begin, end, access_hint::willneed);
+    }
+
+    /// \returns Whether batched reads go through io_uring.
+    bool uses_io_uring() const
+    {
+#ifdef MEMORY_VIEW_IO_URING
+        return state_ != nullptr && state_->ring != nullptr && !state_->ring_failed;
+#else
+        return false;
+#endif
+    }
+
+private:
+    void read_many(gsl::span<const byte_range> ranges,
+                   gsl::span<slice_data> out) const
+    {
+#ifdef MEMORY_VIEW_IO_URING
+        if (uses_io_uring()) {
+            std::vector<detail::io_uring_queue::read_request> requests;
+            for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+                const auto& range = ranges[idx];
+                if (range.begin == range.end) {
+                    out[idx] = {nullptr, nullptr};
+                    continue;
+                }
+                auto buffer = detail::pooled_slice::make(range.begin, range.end);
+                requests.push_back({buffer.data,
+                                    static_cast<std::size_t>(range.end - range.begin),
+                                    range.begin,
+                                    0});
+                out[idx] = buffer;
+            }
+            try {
+                state_->ring->read(state_->fd, requests);
+            } catch (const std::system_error&) {
+                // The queue is unusable, e.g., for lack of resources, so fall
+                // back to `pread`, for this batch and all later ones.
+                state_->ring_failed = true;
+                for (auto& request : requests) { request.result = 0; }
+            }
+            for (const auto& request : requests) {
+                if (request.result < 0) {
+                    throw std::system_error(
+                        -request.result, std::generic_category(), "io_uring read");
+                }
+                auto done = static_cast<std::size_t>(request.result);
+                if (done < request.length) {
+                    detail::pread_all(state_->fd,
+                                      request.buffer + done,
+                                      request.length - done,
+                                      request.offset + done);
+                }
+            }
+            return;
+        }
+#endif
+        for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+            out[idx] = slice(ranges[idx].begin, ranges[idx].end);
+        }
+    }
+
+    struct file_state {
+        file_state() = default;
+        file_state(const file_state&) = delete;
+        file_state(file_state&&) = delete;
+        file_state& operator=(const file_state&) = delete;
+        file_state& operator=(file_state&&) = delete;
+        ~file_state()
+        {
+            if (fd >= 0) { close(fd); }
+        }
+        int fd = -1;
+        std::size_t size = 0;
+#ifdef MEMORY_VIEW_IO_URING
+        std::unique_ptr<detail::io_uring_queue> ring = nullptr;
+        std::atomic<bool> ring_failed{false};
+#endif
+    };
+
+    std::shared_ptr<file_state> state_ = nullptr;
+};
+
+/// An append-only output file.
+///
+/// Each call to `append()` reserves the next range of the file and returns
+/// a writable view of a buffer for it. The buffer is written to the file
+/// at its reserved offset once the last view of it is released, so ranges
+/// can be filled in any order, also from several threads at once, and only
+/// the ranges being filled are held in memory.
+///
+/// Write errors cannot be reported when a buffer is released; the first
+/// of them is thrown by the next call to `sync()`. Calling `sync()` once
+/// all views are released is therefore mandatory: in debug builds, an
+/// assertion fails if the last handle goes away with an error that was
+/// never thrown.
+class file_sink {
+public:
+    /// Creates the file at `path`, or truncates it if it exists.
+    ///
+    /// \throws std::system_error if the file cannot be opened.
+    explicit file_sink(const std::string& path) : state_(std::make_shared<sink_state>())
+    {
+        state_->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (state_->fd < 0) {
+            throw std::system_error(
+                errno, std::generic_category(), "file_sink: " + path);
+        }
+    }
+
+    /// A sink always writes to a file.
+    file_sink() = delete;
+    ~file_sink() = default;
+    file_sink(const file_sink&) = default;
+    file_sink(file_sink&&) = default;
+    file_sink& operator=(const file_sink&) = default;
+    file_sink& operator=(file_sink&&) = default;
+
+    /// Reserves the next `size` bytes of the file.
+    /// This function is thread-safe.
+    mutable_memory_view append(std::size_t size)
+    {
+        auto offset = state_->size.fetch_add(size, std::memory_order_relaxed);
+        return mutable_memory_view(append_source{
+            std::make_shared<append_buffer>(state_, static_cast<off_t>(offset), size)});
+    }
+
+    /// \returns The number of bytes reserved so far.
+    std::size_t size() const { return state_->size.load(std::memory_order_relaxed); }
+
+    /// Waits until all released buffers are written to the storage.
+    ///
+    /// \throws std::system_error if any write failed.
+    void sync() const
+    {
+        state_->rethrow();
+        if (fdatasync(state_->fd) < 0) {
+            throw std::system_error(errno, std::generic_category(), "fdatasync");
+        }
+    }
+
+private:
+    struct sink_state {
+        sink_state() = default;
+        sink_state(const sink_state&) = delete;
+        sink_state(sink_state&&) = delete;
+        sink_state& operator=(const sink_state&) = delete;
+        sink_state& operator=(sink_state&&) = delete;
+        ~sink_state()
+        {
+            assert((!error_code || error_thrown)
+                   && "file_sink: a write failed, but sync() was never called");
+            if (fd >= 0) { close(fd); }
+        }
+
+        void write(const char* data, std::size_t length, off_t offset) noexcept
+        {
+            try {
+                detail::pwrite_all(fd, data, length, offset);
+            } catch (const std::system_error& error) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error_code) { error_code = error.code(); }
+            }
+        }
+
+        void rethrow()
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (error_code) {
+                error_thrown = true;
+                throw std::system_error(error_code, "file_sink: write failed");
+            }
+        }
+
+        int fd = -1;
+        std::atomic<std::size_t> size{0};
+        std::mutex error_mutex;
+        std::error_code error_code{};
+        bool error_thrown = false;
+    };
+
+    /// A buffer for a reserved range, written to the file when released.
+    class append_buffer : public base_handler {
+    public:
+        append_buffer(std::shared_ptr<sink_state> sink, off_t offset, std::size_t size)
+            : sink_(std::move(sink)),
+              buffer_(pooled_handler::make(size)),
+              offset_(offset)
+        {}
+
+        append_buffer() = delete;
+        append_buffer(const append_buffer&) = delete;
+        append_buffer(append_buffer&&) = delete;
+        append_buffer& operator=(const append_buffer&) = delete;
+        append_buffer& operator=(append_buffer&&) = delete;
+        ~append_buffer() { sink_->write(buffer_->data(), buffer_->size(), offset_); }
+
+        char* data() { return buffer_->data(); }
+        std::size_t size() const { return buffer_->size(); }
+
+        /// Writes `[begin, end)` of the buffer right away.
+        void write(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode)
+        {
+            detail::pwrite_all(sink_->fd, std::next(data(), begin), end - begin, offset_ + begin);
+            if (mode == flush_mode::sync && fdatasync(sink_->fd) < 0) {
+                throw std::system_error(errno, std::generic_category(), "fdatasync");
+            }
+        }
+
+    private:
+        std::shared_ptr<sink_state> sink_;
+        std::shared_ptr<pooled_handler> buffer_;
+        off_t offset_;
+    };
+
+    struct append_source {
+        const mutable_slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+        {
+            return {std::next(buffer->data(), begin), buffer};
+        }
+        std::size_t size() const { return buffer->size(); }
+        /// The range is written again once the buffer is released.
+        void flush(std::ptrdiff_t begin, std::ptrdiff_t end, flush_mode mode) const
+        {
+            buffer->write(begin, end, mode);
+        }
+
+        std::shared_ptr<append_buffer> buffer;
+    };
+
+    std::shared_ptr<sink_state> state_ = nullptr;
+};
+
+/// Options of `load_into_memory`.
+struct load_options {
+    /// Number of threads copying data; zero means one per hardware thread.
+    unsigned threads = 0;
+    /// Number of bytes copied by a thread at a time.
+    std::size_t chunk_size = std::size_t{8} << 20;
+    /// Pages backing the loaded data.
+    page_kind pages = page_kind::transparent_huge;
+    /// Whether files are read with `O_DIRECT`, bypassing the page cache.
+    /// Ignored if the file system does not support it.
+    bool direct = false;
+};
+
+namespace detail {
+
+/// Read-only source over memory owned by an `anonymous_mapping_handler`.
+class anonymous_memory_source {
+public:
+    anonymous_memory_source(const char* ptr,
+                            std::size_t size,
+                            std::shared_ptr<anonymous_mapping_handler> state)
+        : ptr_(ptr), size_(size), state_(std::move(state))
+    {}
+
+    anonymous_memory_source() = default;
+    ~anonymous_memory_source() = default;
+    anonymous_memory_source(const anonymous_memory_source&) = default;
+    anonymous_memory_source(anonymous_memory_source&&) = default;
+    anonymous_memory_source& operator=(const anonymous_memory_source&) = default;
+    anonymous_memory_source& operator=(anonymous_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return {std::next(ptr_, begin), state_};
+    }
+    std::size_t size() const { return size_; }
+    std::size_t alignment() const
+    {
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+private:
+    const char* ptr_ = nullptr;
+    std::size_t size_ = 0;
+    std::shared_ptr<anonymous_mapping_handler> state_ = nullptr;
+};
+
+/// Maps memory for `size` bytes, owned by the returned handler.
+inline std::pair<char*, std::shared_ptr<anonymous_mapping_handler>>
+map_owned(std::size_t size, page_kind pages)
+{
+    auto state = std::make_shared<anonymous_mapping_handler>();
+    char* data = map_anonymous(size, pages);
+    if (data != nullptr) { state->mappings.emplace_back(data, anonymous_length(size, pages)); }
+    return {data, std::move(state)};
+}
+
+/// Reads `[begin, end)` of a file opened with `O_DIRECT` to `out`, where
+/// `begin` and `out` are aligned to a page.
+///
+/// The length is rounded up to a page, so `out` must have room for it, and
+/// bytes past `end` may be written to it; reading stops once `end` is
+/// reached, e.g., at the end of the file. A short read is resumed at the
+/// last page boundary it reached, since direct reads must stay aligned.
+inline void pread_direct(int fd, char* out, std::size_t begin, std::size_t end)
+{
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto length = round_up(end - begin, page);
+    std::size_t done = 0;
+    while (begin + done < end) {
+        auto count = ::pread(fd, out + done, length - done, begin + done);
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            throw std::system_error(errno, std::generic_category(), "pread");
+        }
+        auto reached = done + static_cast<std::size_t>(count);
+        if (begin + reached < end) { reached -= reached % page; }
+        if (reached == done) {
+            throw std::system_error(
+                std::make_error_code(std::errc::io_error),
+                "pread: unexpected end of file");
+        }
+        done = reached;
+    }
+}
+
+/// Reads the file at `path` into memory, as `load_into_memory`, reading
+/// direct chunks with `read_direct`, called as `pread_direct`.
+///
+/// Whether direct reads work is decided once, before the workers start: the
+/// first page is read directly, and the file is reopened without `O_DIRECT`
+/// if the file system rejects it, so that all workers read the same way.
+template<typename ReadDirect>
+memory_view load_file(const std::string& path, const load_options& options, ReadDirect read_direct)
+{
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if (options.direct) { flags |= O_DIRECT; }
+#endif
+    int fd = open(path.c_str(), flags);
+    if (fd < 0 && flags != O_RDONLY && errno == EINVAL) {
+        flags = O_RDONLY;
+        fd = open(path.c_str(), flags);
+    }
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        auto error = errno;
+        if (fd >= 0) { close(fd); }
+        throw std::system_error(error, std::generic_category(), "load_into_memory: " + path);
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto chunk_size = options.chunk_size;
+    if (flags != O_RDONLY) {
+        chunk_size = round_up(std::max<std::size_t>(chunk_size, 1), page);
+    }
+    try {
+        auto [data, state] = map_owned(size, options.pages);
+        if (flags != O_RDONLY && size > 0) {
+            try {
+                read_direct(fd, data, 0, std::min(size, page));
+            } catch (const std::system_error& error) {
+                if (error.code() != std::errc::invalid_argument) { throw; }
+                close(fd);
+                flags = O_RDONLY;
+                fd = open(path.c_str(), flags);
+                if (fd < 0) {
+                    throw std::system_error(
+                        errno, std::generic_category(), "load_into_memory: " + path);
+                }
+            }
+        }
+        parallel_chunks(size, chunk_size, options.threads, [&, data = data](auto begin, auto end) {
+            if (flags != O_RDONLY) {
+                read_direct(fd, data + begin, begin, end);
+            } else {
+                pread_all(fd, data + begin, end - begin, begin);
+            }
+        });
+        close(fd);
+        return memory_view(anonymous_memory_source(data, size, std::move(state)));
+    } catch (...) {
+        if (fd >= 0) { close(fd); }
+        throw;
+    }
+}
+
+}  // namespace detail
+
+/// Copies all data of `view` into memory, from multiple threads.
+///
+/// Each thread slices and copies chunks of `options.chunk_size` bytes,
+/// so the source of `view` must support concurrent slicing;
+/// use a single thread for sources such as `istream_memory_source`.
+///
+/// \returns A view owning the copy, aligned to a page.
+inline memory_view load_into_memory(const memory_view& view, const load_options& options = {})
+{
+    auto [data, state] = detail::map_owned(view.size(), options.pages);
+    detail::parallel_chunks(
+        view.size(), options.chunk_size, options.threads, [&, data = data](auto begin, auto end) {
+            auto chunk = view(begin, end);
+            MEMORY_VIEW_TRACE(bytes_copied, end - begin);
+            std::memcpy(data + begin, chunk.as_ptr(), end - begin);
+        });
+    return memory_view(detail::anonymous_memory_source(data, view.size(), std::move(state)));
+}
+
+/// Reads the file at `path` into memory, from multiple threads, each
+/// reading chunks of `options.chunk_size` bytes.
+///
+/// \returns A view owning the data, aligned to a page.
+/// \throws std::system_error if the file cannot be opened or read.
+inline memory_view load_into_memory(const std::string& path, const load_options& options = {})
+{
+    return detail::load_file(path, options, detail::pread_direct);
+}
+
+#endif
+
+/// A block of data held by a `block_cache`.
+///
+/// Slices served from a cached block hold it as their handler, which pins
+/// the block: it is never evicted while any view still references it.
+class cached_block : public base_handler {
+public:
+    /// \param offset  Position of the block within its source.
+    cached_block(slice_data data, std::size_t size, std::ptrdiff_t offset = 0)
+        : data_(std::move(data)), size_(size), offset_(offset)
+    {}
+
+    const char* data() const { return data_.ptr; }
+    std::size_t size() const { return size_; }
+    std::ptrdiff_t offset() const { return offset_; }
+
+private:
+    slice_data data_;
+    std::size_t size_ = 0;
+    std::ptrdiff_t offset_ = 0;
+};
+
+/// Identifies a cached block: the index of a block within a source
+/// registered with `block_cache::register_source()`.
+struct block_key {
+    std::uint64_t source;
+    std::uint64_t block;
+
+    bool operator==(const block_key& other) const
+    {
+        return source == other.source && block == other.block;
+    }
+};
+
+/// Hot blocks of a `block_cache`, identified by the names of their sources
+/// and their positions, so that they can be loaded again with `warm_up()`,
+/// e.g., after a restart. The data of the blocks is not included.
+struct cache_snapshot {
+    struct entry {
+        std::string source;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    /// Writes the snapshot to the file at `path`.
+    ///
+    /// \throws std::runtime_error if the file cannot be written.
+    void save(const std::string& path) const
+    {
+        std::vector<std::string> names;
+        std::unordered_map<std::string, std::uint32_t> name_index;
+        for (const auto& entry : entries) {
+            if (name_index.emplace(entry.source, names.size()).second) {
+                names.push_back(entry.source);
+            }
+        }
+        std::string out(magic, sizeof(magic));
+        append<std::uint32_t>(out, names.size());
+        for (const auto& name : names) {
+            append<std::uint32_t>(out, name.size());
+            out += name;
+        }
+        append<std::uint64_t>(out, entries.size());
+        for (const auto& entry : entries) {
+            append<std::uint32_t>(out, name_index[entry.source]);
+            append<std::uint64_t>(out, entry.offset);
+            append<std::uint64_t>(out, entry.size);
+        }
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file.flush()) {
+            throw std::runtime_error("cache_snapshot: cannot write " + path);
+        }
+    }
+
+    /// Reads a snapshot written by `save()`.
+    ///
+    /// \throws std::runtime_error if the file cannot be read or is invalid.
+    static cache_snapshot load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.good() && !file.eof()) {
+            throw std::runtime_error("cache_snapshot: cannot read " + path);
+        }
+        auto invalid = std::runtime_error("cache_snapshot: invalid file " + path);
+        if (in.compare(0, sizeof(magic), magic, sizeof(magic)) != 0) { throw invalid; }
+        std::size_t pos = sizeof(magic);
+        auto take = [&](std::size_t length) {
+            if (in.size() - pos < length) { throw invalid; }
+            pos += length;
+            return in.data() + pos - length;
+        };
+        cache_snapshot snapshot;
+        auto name_count = detail::load<std::uint32_t, endian::little>(take(4));
+        // Each name takes at least its length field.
+        if ((in.size() - pos) / 4 < name_count) { throw invalid; }
+        std::vector<std::string> names(name_count);
+        for (auto& name : names) {
+            auto length = detail::load<std::uint32_t, endian::little>(take(4));
+            name.assign(take(length), length);
+        }
+        auto count = detail::load<std::uint64_t, endian::little>(take(8));
+        for (std::uint64_t idx = 0; idx < count; ++idx) {
+            auto name = detail::load<std::uint32_t, endian::little>(take(4));
+            if (name >= names.size()) { throw invalid; }
+            auto offset = detail::load<std::uint64_t, endian::little>(take(8));
+            auto size = detail::load<std::uint64_t, endian::little>(take(8));
+            snapshot.entries.push_back({names[name], offset, size});
+        }
+        return snapshot;
+    }
+
+    std::vector<entry> entries;
+
+private:
+    static constexpr char magic[4] = {'m', 'v', 'c', '1'};
+
+    template<typename T>
+    static void append(std::string& out, std::size_t value)
+    {
+        char buffer[sizeof(T)];
+        detail::store<T, endian::little>(buffer, static_cast<T>(value));
+        out.append(buffer, sizeof(T));
+    }
+};
+
+/// A bounded LRU cache of blocks with a byte budget, which can be shared
+/// by many sources.
+///
+/// The cache is split into shards, each with its own lock, LRU list, and
+/// an equal part of the budget, so that concurrent lookups of different
+/// blocks rarely contend. Blocks are loaded outside of the lock, so a slow
+/// fetch does not block lookups of other blocks. Pinned blocks are skipped
+/// during eviction; if every block is pinned, the cache may temporarily
+/// exceed its budget.
+class block_cache {
+public:
+    /// \param capacity    Cache budget in bytes.
+    /// \param shards      Number of independently locked shards.
+    explicit block_cache(std::size_t capacity, std::size_t shards = 1)
+        : shards_(std::max<std::size_t>(shards, 1))
+    {
+        set_capacity(capacity);
+    }
+
+    block_cache() = delete;
+    block_cache(const block_cache&) = delete;
+    block_cache(block_cache&&) = delete;
+    block_cache& operator=(const block_cache&) = delete;
+    block_cache& operator=(block_cache&&) = delete;
+    ~block_cache() = default;
+
+    /// A process-wide cache, meant to be shared by all sources that should
+    /// count against a single budget. It starts with a 256 MiB budget,
+    /// which can be changed with `set_capacity()`.
+    /// It is never destroyed, so blocks may outlive static objects.
+    static const std::shared_ptr<block_cache>& global()
+    {
+        static auto* cache = new std::shared_ptr<block_cache>(
+            std::make_shared<block_cache>(std::size_t{256} << 20, 64));
+        return *cache;
+    }
+
+    /// \returns A new source identifier, unique within the process.
+    std::uint64_t register_source()
+    {
+        static std::atomic<std::uint64_t> next_source{0};
+        return next_source.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Names `source` in snapshots. Blocks of unnamed sources are left out
+    /// of them. Names should identify the data across restarts, e.g., paths.
+    void name_source(std::uint64_t source, std::string name)
+    {
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        names_[source] = std::move(name);
+    }
+
+    /// \returns The most recently used blocks of named sources, at most
+    ///          `max_blocks` of them, hottest first. The order is exact
+    ///          within each shard and interleaved across shards.
+    cache_snapshot snapshot(
+        std::size_t max_blocks = std::numeric_limits<std::size_t>::max()) const
+    {
+        std::unordered_map<std::uint64_t, std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(names_mutex_);
+            names = names_;
+        }
+        std::vector<std::vector<cache_snapshot::entry>> hot(shards_.size());
+        for (std::size_t idx = 0; idx < shards_.size(); ++idx) {
+            std::lock_guard<std::mutex> lock(shards_[idx].mutex);
+            for (const auto& entry : shards_[idx].lru) {
+                if (hot[idx].size() == max_blocks) { break; }
+                if (auto name = names.find(entry.key.source); name != names.end()) {
+                    hot[idx].push_back({name->second,
+                                        static_cast<std::uint64_t>(entry.block->offset()),
+                                        entry.block->size()});
+                }
+            }
+        }
+        cache_snapshot snapshot;
+        for (std::size_t rank = 0; snapshot.entries.size() < max_blocks; ++rank) {
+            auto previous = snapshot.entries.size();
+            for (const auto& shard : hot) {
+                if (rank < shard.size() && snapshot.entries.size() < max_blocks) {
+                    snapshot.entries.push_back(shard[rank]);
+                }
+            }
+            if (snapshot.entries.size() == previous) { break; }
+        }
+        return snapshot;
+    }
+
+    /// Drops all unpinned blocks of `source`, e.g., once it is closed.
+    /// Takes time proportional to the number of shards and blocks of
+    /// `source`, regardless of how many other blocks are cached.
+    void erase_source(std::uint64_t source)
+    {
+        {
+            std::lock_guard<std::mutex> lock(names_mutex_);
+            names_.erase(source);
+        }
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto blocks = shard.sources.find(source);
+            if (blocks == shard.sources.end()) { continue; }
+            std::vector<std::uint64_t> indices(blocks->second.begin(), blocks->second.end());
+            for (auto block : indices) {
+                auto pos = shard.index.at({source, block});
+                if (pos->block.use_count() == 1) { shard.erase(pos); }
+            }
+        }
+    }
+
+    /// Returns the block identified by `key`, calling `load()` to create
+    /// it if it is not cached. Lookups of a block that another thread is
+    /// loading wait for that load, and rethrow its failure, instead of
+    /// loading the block again.
+    ///
+    /// \tparam Loader  A callable returning `std::shared_ptr<cached_block>`.
+    template<typename Loader>
+    std::shared_ptr<cached_block> get(block_key key, Loader load)
+    {
+        auto& shard = shard_of(key);
+        std::promise<std::shared_ptr<cached_block>> loaded;
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            if (auto block = shard.find(key); block != nullptr) {
+                ++shard.hits;
+                return block;
+            }
+            if (auto pending = shard.loading.find(key); pending != shard.loading.end()) {
+                auto block = pending->second;
+                ++shard.hits;
+                lock.unlock();
+                return block.get();
+            }
+            shard.loading.emplace(key, loaded.get_future().share());
+        }
+        try {
+            auto block = insert(key, load());
+            finish_loading(shard, key);
+            loaded.set_value(block);
+            return block;
+        } catch (...) {
+            finish_loading(shard, key);
+            loaded.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    /// \returns The block identified by `key`, or `nullptr` if it is not
+    ///          cached.
+    std::shared_ptr<cached_block> find(block_key key)
+    {
+        auto& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto block = shard.find(key);
+        if (block != nullptr) { ++shard.hits; }
+        return block;
+    }
+
+    /// \returns Whether the block identified by `key` is cached. Unlike
+    ///          `find()`, this neither counts a lookup nor marks it used.
+    bool contains(block_key key) const
+    {
+        auto& shard = shards_[key_hash{}(key) % shards_.size()];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.index.count(key) > 0;
+    }
+
+    /// Adds a loaded block, counting it as a miss.
+    /// If another thread has inserted the same block in the meantime, that
+    /// block is kept and returned instead.
+    std::shared_ptr<cached_block> insert(block_key key, std::shared_ptr<cached_block> block)
+    {
+        auto& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.misses;
+        if (auto cached = shard.find(key); cached != nullptr) { return cached; }
+        shard.lru.push_front({key, block});
+        shard.index[key] = shard.lru.begin();
+        shard.sources[key.source].insert(key.block);
+        shard.size += block->size();
+        shard.evict();
+        return block;
+    }
+
+    /// \returns The number of bytes currently held by the cache.
+    std::size_t size() const
+    {
+        return sum([](const shard& shard) { return shard.size; });
+    }
+
+    std::size_t capacity() const { return capacity_.load(std::memory_order_relaxed); }
+
+    /// \returns The number of lookups served from the cache.
+    std::uint64_t hits() const
+    {
+        return sum([](const shard& shard) { return shard.hits; });
+    }
+
+    /// \returns The number of lookups that loaded a block.
+    std::uint64_t misses() const
+    {
+        return sum([](const shard& shard) { return shard.misses; });
+    }
+
+    /// Changes the budget, evicting blocks that no longer fit.
+    void set_capacity(std::size_t capacity)
+    {
+        capacity_.store(capacity, std::memory_order_relaxed);
+        for (std::size_t idx = 0; idx < shards_.size(); ++idx) {
+            auto& shard = shards_[idx];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            // Spread the remainder so that the shard budgets add up.
+            shard.capacity = capacity / shards_.size()
+                + (idx < capacity % shards_.size() ? 1 : 0);
+            shard.evict();
+        }
+    }
+
+private:
+    struct key_hash {
+        std::size_t operator()(const block_key& key) const
+        {
+            std::uint64_t hash = key.source * 0x9E3779B97F4A7C15ull ^ key.block;
+            hash ^= hash >> 29;
+            hash *= 0xBF58476D1CE4E5B9ull;
+            return static_cast<std::size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    struct entry {
+        block_key key;
+        std::shared_ptr<cached_block> block;
+    };
+
+    struct shard {
+        std::shared_ptr<cached_block> find(const block_key& key)
+        {
+            auto pos = index.find(key);
+            if (pos == index.end()) { return nullptr; }
+            lru.splice(lru.begin(), lru, pos->second);
+            return pos->second->block;
+        }
+
+        void evict()
+        {
+            auto pos = lru.end();
+            while (size > capacity && pos != lru.begin()) {
+                --pos;
+                if (pos->block.use_count() > 1) { continue; }
+                pos = erase(pos);
+            }
+        }
+
+        std::list<entry>::iterator erase(std::list<entry>::iterator pos)
+        {
+            size -= pos->block->size();
+            index.erase(pos->key);
+            auto blocks = sources.find(pos->key.source);
+            blocks->second.erase(pos->key.block);
+            if (blocks->second.empty()) { sources.erase(blocks); }
+            return lru.erase(pos);
+        }
+
+        mutable std::mutex mutex;
+        std::list<entry> lru;
+        std::unordered_map<block_key, std::list<entry>::iterator, key_hash> index;
+        /// The cached blocks of each source, so that they can be erased
+        /// without scanning the whole shard.
+        std::unordered_map<std::uint64_t, std::unordered_set<std::uint64_t>> sources;
+        /// Blocks being loaded by `get()`.
+        std::unordered_map<block_key, std::shared_future<std::shared_ptr<cached_block>>, key_hash>
+            loading;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    shard& shard_of(const block_key& key)
+    {
+        return shards_[key_hash{}(key) % shards_.size()];
+    }
+
+    static void finish_loading(shard& shard, const block_key& key)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.loading.erase(key);
+    }
+
+    template<typename Field>
+    std::uint64_t sum(Field field) const
+    {
+        std::uint64_t total = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += field(shard);
+        }
+        return total;
+    }
+
+    std::vector<shard> shards_;
+    std::atomic<std::size_t> capacity_{0};
+    mutable std::mutex names_mutex_;
+    std::unordered_map<std::uint64_t, std::string> names_;
+};
+
+namespace detail {
+
+/// \returns `block_size`.
+/// \throws std::invalid_argument if `block_size` is zero.
+inline std::size_t checked_block_size(std::size_t block_size, const char* source)
+{
+    if (block_size == 0) {
+        throw std::invalid_argument(std::string(source) + ": block size must be positive");
+    }
+    return block_size;
+}
+
+/// \returns `source.slice(begin, end)`, holding `mutex` during the call
+///          unless `Source` is thread-safe.
+template<typename Source>
+slice_data guarded_slice(const Source& source,
+                         std::mutex& mutex,
+                         std::ptrdiff_t begin,
+                         std::ptrdiff_t end)
+{
+    if constexpr (is_thread_safe<Source>::value) {
+        return source.slice(begin, end);
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        return source.slice(begin, end);
+    }
+}
+
+/// Serves `[begin, end)` from the consecutive blocks `first` to `last`.
+/// A range within a single block points directly into it; otherwise,
+/// the overlapping parts of all blocks are copied into a pooled buffer.
+///
+/// \param start   Returns the offset at which the given block begins.
+/// \param fetch   Returns the `std::shared_ptr<cached_block>` of a block.
+template<typename Start, typename Fetch>
+slice_data slice_blocks(std::ptrdiff_t begin,
+                        std::ptrdiff_t end,
+                        std::ptrdiff_t first,
+                        std::ptrdiff_t last,
+                        Start start,
+                        Fetch fetch)
+{
+    if (first == last) {
+        auto block = fetch(first);
+        return {std::next(block->data(), begin - start(first)), block};
+    }
+    auto buffer = pooled_slice::make(begin, end);
+    for (auto idx = first; idx <= last; ++idx) {
+        auto block = fetch(idx);
+        auto block_begin = start(idx);
+        auto block_end = block_begin + static_cast<std::ptrdiff_t>(block->size());
+        auto from = std::max(begin, block_begin);
+        auto to = std::min(end, block_end);
+        MEMORY_VIEW_TRACE(bytes_copied, to - from);
+        std::copy(std::next(block->data(), from - block_begin),
+                  std::next(block->data(), to - block_begin),
+                  std::next(buffer.data, from - begin));
+    }
+    return buffer;
+}
+
+/// Runs `load` in a detached thread, unless `limit` threads counted by
+/// `running` are already in progress. Failures, including a failure to
+/// start the thread, are ignored. `load` must keep the object owning
+/// `running` alive.
+template<typename Load>
+void load_in_background(std::atomic<int>& running, int limit, Load load)
+{
+    if (running.fetch_add(1) >= limit) {
+        --running;
+        return;
+    }
+    try {
+        std::thread([&running, load = std::move(load)]() {
+            try {
+                load();
+            } catch (...) {
+            }
+            --running;
+        }).detach();
+    } catch (...) {
+        --running;
+    }
+}
+
+}  // namespace detail
+
+/// Memory source caching another source in fixed-size aligned blocks.
+///
+/// A slice contained in a single block points directly into the cached
+/// block; a slice crossing block boundaries is assembled into a new buffer.
+/// Missing blocks are fetched concurrently, each only once at a time. Only
+/// fetches from sources that are not thread-safe, such as
+/// `istream_memory_source`, are serialized; a `memory_view` counts as
+/// thread-safe, so do not wrap one over such a source.
+///
+/// Copies of the source share the same cache. The cache can also be shared
+/// with other sources, e.g., `block_cache::global()`, to keep all of them
+/// within one budget; blocks of a source are dropped from a shared cache
+/// once the source and all its copies are destroyed.
+template<typename Source>
+class cached_memory_source {
+public:
+    /// \param source       Underlying memory source.
+    /// \param block_size   Size of a cached block in bytes.
+    /// \param capacity     Cache budget in bytes.
+    /// \throws std::invalid_argument if `block_size` is zero.
+    cached_memory_source(Source source,
+                         std::size_t block_size,
+                         std::size_t capacity)
+        : cached_memory_source(std::move(source),
+                               block_size,
+                               std::make_shared<block_cache>(capacity))
+    {}
+
+    /// \param source       Underlying memory source.
+    /// \param block_size   Size of a cached block in bytes.
+    /// \param cache        Cache shared with other sources.
+    /// \throws std::invalid_argument if `block_size` is zero.
+    cached_memory_source(Source source,
+                         std::size_t block_size,
+                         std::shared_ptr<block_cache> cache)
+        : state_(std::make_shared<state>(
+              std::move(source),
+              detail::checked_block_size(block_size, "cached_memory_source"),
+              std::move(cache)))
+    {}
+
+    /// A cached source always has an underlying source and a cache.
+    cached_memory_source() = delete;
+    ~cached_memory_source() = default;
+    cached_memory_source(const cached_memory_source&) = default;
+    cached_memory_source(cached_memory_source&&) = default;
+    cached_memory_source& operator=(const cached_memory_source&) = default;
+    cached_memory_source& operator=(cached_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return {nullptr, nullptr}; }
+        auto block_size = static_cast<std::ptrdiff_t>(state_->block_size);
+        auto first = begin / block_size;
+        auto last = (end - 1) / block_size;
+        return detail::slice_blocks(
+            begin,
+            end,
+            first,
+            last,
+            [block_size](auto idx) { return idx * block_size; },
+            [this](auto idx) { return fetch(idx); });
+    }
+    std::size_t size() const { return state_->source.size(); }
+    void advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+    {
+        if constexpr (detail::has_advise<Source>::value) {
+            state_->source.advise(begin, end, hint);
+        }
+    }
+    /// Forwards the prefetch to the underlying source, and loads the blocks
+    /// of `[begin, end)` into the cache in a background thread, unless four
+    /// prefetches are already in progress. Failed prefetches are ignored.
+    void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return; }
+        detail::prefetch(state_->source, begin, end);
+        detail::load_in_background(
+            state_->prefetches, max_prefetches, [self = *this, begin, end]() {
+                auto block_size = static_cast<std::ptrdiff_t>(self.state_->block_size);
+                for (auto idx = begin / block_size; idx <= (end - 1) / block_size; ++idx) {
+                    self.fetch(idx);
+                }
+            });
+    }
+
+    /// Slices within a block keep the alignment of the underlying source,
+    /// up to that of the block size; copied slices are pool aligned.
+    std::size_t alignment() const
+    {
+        auto block_size = state_->block_size;
+        return std::min({detail::alignment(state_->source),
+                         block_size & (~block_size + 1),
+                         buffer_pool::alignment});
+    }
+
+    const block_cache& cache() const { return *state_->cache; }
+
+    /// \returns The identifier of this source in its cache.
+    std::uint64_t source_id() const { return state_->id; }
+
+private:
+    static constexpr int max_prefetches = 4;
+
+    struct state {
+        state(Source source, std::size_t block_size, std::shared_ptr<block_cache> cache)
+            : source(std::move(source)),
+              block_size(block_size),
+              cache(std::move(cache)),
+              id(this->cache->register_source())
+        {}
+        state() = delete;
+        state(const state&) = delete;
+        state(state&&) = delete;
+        state& operator=(const state&) = delete;
+        state& operator=(state&&) = delete;
+        ~state() { cache->erase_source(id); }
+
+        Source source;
+        std::size_t block_size;
+        std::shared_ptr<block_cache> cache;
+        std::uint64_t id;
+        std::mutex fetch_mutex;
+        std::atomic<int> prefetches{0};
+    };
+
+    std::shared_ptr<cached_block> fetch(std::ptrdiff_t idx) const
+    {
+        block_key key{state_->id, static_cast<std::uint64_t>(idx)};
+        return state_->cache->get(key, [this, idx]() {
+            auto block_size = static_cast<std::ptrdiff_t>(state_->block_size);
+            auto begin = idx * block_size;
+            auto end = std::min(begin + block_size,
+                                static_cast<std::ptrdiff_t>(size()));
+            return std::make_shared<cached_block>(
+                detail::guarded_slice(state_->source, state_->fetch_mutex, begin, end),
+                end - begin,
+                begin);
+        });
+    }
+
+    std::shared_ptr<state> state_ = nullptr;
+};
+
+/// Location of a compressed block within the underlying source.
+struct compressed_block {
+    std::ptrdiff_t offset;
+    std::size_t compressed_size;
+    std::size_t size;
+};
+
+/// Memory source decompressing a block-compressed source on demand.
+///
+/// The source is described by a block index: a list of blocks in the
+/// order of their decompressed data, each given by its position and
+/// compressed size in the underlying source, and its decompressed size.
+/// Only the blocks overlapping a requested range are decompressed, and
+/// decompressed blocks are kept in a `block_cache` with the same pinning
+/// rules as in `cached_memory_source`.
+///
+/// \tparam Codec   A callable decompressing one block:
+///                 ```
+///                 std::size_t operator()(gsl::span<const char> in,
+///                                        gsl::span<char> out) const;
+///                 ```
+///                 It returns the number of decompressed bytes.
+///                 Any codec, such as LZ4 or zstd, can be plugged in.
+template<typename Source, typename Codec>
+class compressed_memory_source {
+public:
+    /// \param source       Underlying source of compressed data.
+    /// \param blocks       Block index.
+    /// \param codec        Decompression function.
+    /// \param capacity     Budget of the decompressed block cache in bytes.
+    compressed_memory_source(Source source,
+                             std::vector<compressed_block> blocks,
+                             Codec codec,
+                             std::size_t capacity)
+        : compressed_memory_source(std::move(source),
+                                   std::move(blocks),
+                                   std::move(codec),
+                                   std::make_shared<block_cache>(capacity))
+    {}
+
+    /// \param source       Underlying source of compressed data.
+    /// \param blocks       Block index.
+    /// \param codec        Decompression function.
+    /// \param cache        Decompressed block cache shared with other sources;
+    ///                     see `cached_memory_source`.
+    compressed_memory_source(Source source,
+                             std::vector<compressed_block> blocks,
+                             Codec codec,
+                             std::shared_ptr<block_cache> cache)
+        : state_(std::make_shared<state>(
+              std::move(source), std::move(blocks), std::move(codec), std::move(cache)))
+    {}
+
+    /// A compressed source always has an underlying source and a cache.
+    compressed_memory_source() = delete;
+    ~compressed_memory_source() = default;
+    compressed_memory_source(const compressed_memory_source&) = default;
+    compressed_memory_source(compressed_memory_source&&) = default;
+    compressed_memory_source& operator=(const compressed_memory_source&) = default;
+    compressed_memory_source& operator=(compressed_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return {nullptr, nullptr}; }
+        const auto& starts = state_->starts;
+        auto block_of = [&starts](std::ptrdiff_t pos) {
+            return std::upper_bound(starts.begin(), starts.end(), pos)
+                - starts.begin() - 1;
+        };
+        return detail::slice_blocks(
+            begin,
+            end,
+            block_of(begin),
+            block_of(end - 1),
+            [&starts](auto idx) { return starts[idx]; },
+            [this](auto idx) { return fetch(idx); });
+    }
+    std::size_t size() const { return state_->starts.back(); }
+
+    const block_cache& cache() const { return *state_->cache; }
+
+    /// \returns The identifier of this source in its cache.
+    std::uint64_t source_id() const { return state_->id; }
+
+private:
+    struct state {
+        state(Source source,
+              std::vector<compressed_block> blocks,
+              Codec codec,
+              std::shared_ptr<block_cache> cache)
+            : source(std::move(source)),
+              blocks(std::move(blocks)),
+              codec(std::move(codec)),
+              cache(std::move(cache)),
+              id(this->cache->register_source())
+        {
+            starts.reserve(this->blocks.size() + 1);
+            starts.push_back(0);
+            for (const auto& block : this->blocks) {
+                starts.push_back(starts.back() + block.size);
+            }
+        }
+        state() = delete;
+        state(const state&) = delete;
+        state(state&&) = delete;
+        state& operator=(const state&) = delete;
+        state& operator=(state&&) = delete;
+        ~state() { cache->erase_source(id); }
+
+        Source source;
+        std::vector<compressed_block> blocks;
+        std::vector<std::ptrdiff_t> starts;
+        Codec codec;
+        std::shared_ptr<block_cache> cache;
+        std::uint64_t id;
+        std::mutex fetch_mutex;
+    };
+
+    std::shared_ptr<cached_block> fetch(std::ptrdiff_t idx) const
+    {
+        block_key key{state_->id, static_cast<std::uint64_t>(idx)};
+        return state_->cache->get(key, [this, idx]() {
+            const auto& block = state_->blocks[idx];
+            auto compressed = detail::guarded_slice(
+                state_->source,
+                state_->fetch_mutex,
+                block.offset,
+                block.offset + static_cast<std::ptrdiff_t>(block.compressed_size));
+            auto handler = pooled_handler::make(block.size);
+            auto size = state_->codec(
+                gsl::span<const char>(compressed.ptr, block.compressed_size),
+                gsl::span<char>(handler->data(), block.size));
+            if (size != block.size) {
+                throw std::runtime_error(
+                    "compressed_memory_source: invalid block "
+                    + std::to_string(idx));
+            }
+            return std::make_shared<cached_block>(
+                slice_data{handler->data(), handler}, block.size, state_->starts[idx]);
+        });
+    }
+
+    std::shared_ptr<state> state_ = nullptr;
+};
+
+/// Memory source for high-latency backends, such as objects in a remote
+/// store read with HTTP range requests.
+///
+/// Data is fetched in blocks of `block_size` bytes, which are kept in a
+/// `block_cache`, by default `block_cache::global()`. A fetch requests only
+/// the missing blocks, and missing blocks separated by at most `gap` bytes
+/// of uncached data are requested together, so that nearby ranges,
+/// including all ranges of one `mv::fetch()` call, cost as few round trips
+/// as possible.
+/// `prefetch()` loads blocks in a background thread.
+///
+/// \tparam Transport  Performs the requests; it must be thread-safe:
+///                    ```
+///                    std::size_t size() const;
+///                    void get(std::ptrdiff_t begin,
+///                             std::ptrdiff_t end,
+///                             char* out) const;
+///                    ```
+///                    where `get` writes the bytes `[begin, end)` of the
+///                    object to `out`, or throws if it fails.
+template<typename Transport>
+class remote_memory_source {
+public:
+    /// \param transport    Performs the requests.
+    /// \param block_size   Size of a fetched block in bytes.
+    /// \param cache        Cache of fetched blocks.
+    /// \param gap          Largest distance between missing blocks that are
+    ///                     still requested together.
+    /// \throws std::invalid_argument if `block_size` is zero.
+    explicit remote_memory_source(Transport transport,
+                                  std::size_t block_size = 1u << 20,
+                                  std::shared_ptr<block_cache> cache = block_cache::global(),
+                                  std::size_t gap = 1u << 20)
+        : state_(std::make_shared<state>(
+              std::move(transport),
+              detail::checked_block_size(block_size, "remote_memory_source"),
+              std::move(cache),
+              gap))
+    {}
+
+    /// A remote source always has a transport and a cache.
+    remote_memory_source() = delete;
+    ~remote_memory_source() = default;
+    remote_memory_source(const remote_memory_source&) = default;
+    remote_memory_source(remote_memory_source&&) = default;
+    remote_memory_source& operator=(const remote_memory_source&) = default;
+    remote_memory_source& operator=(remote_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return {nullptr, nullptr}; }
+        byte_range range{begin, end};
+        auto needed = blocks_of(gsl::span<const byte_range>(&range, 1));
+        auto blocks = load(*state_, needed);
+        return serve(begin, end, needed, blocks);
+    }
+
+    /// Fetches the missing blocks of all `ranges` at once.
+    void slice_many(gsl::span<const byte_range> ranges, gsl::span<slice_data> out) const
+    {
+        auto needed = blocks_of(ranges);
+        auto blocks = load(*state_, needed);
+        for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+            const auto& range = ranges[idx];
+            out[idx] = range.begin == range.end
+                ? slice_data{nullptr, nullptr}
+                : serve(range.begin, range.end, needed, blocks);
+        }
+    }
+
+    /// Starts fetching the missing blocks of `[begin, end)` in a background
+    /// thread, unless four prefetches are already in progress.
+    /// Failed prefetches are ignored.
+    void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return; }
+        byte_range range{begin, end};
+        detail::load_in_background(
+            state_->prefetches,
+            max_prefetches,
+            [state = state_, needed = blocks_of(gsl::span<const byte_range>(&range, 1))]() {
+                load(*state, needed);
+            });
+    }
+
+    std::size_t size() const { return state_->size; }
+
+    std::size_t alignment() const
+    {
+        auto block_size = static_cast<std::size_t>(state_->block_size);
+        return std::min(block_size & (~block_size + 1), buffer_pool::alignment);
+    }
+
+    const Transport& transport() const { return state_->transport; }
+
+    /// \returns The identifier of this source in its cache.
+    std::uint64_t source_id() const { return state_->id; }
+
+private:
+    static constexpr int max_prefetches = 4;
+
+    struct state {
+        state(Transport transport,
+              std::size_t block_size,
+              std::shared_ptr<block_cache> cache,
+              std::size_t gap)
+            : transport(std::move(transport)),
+              size(this->transport.size()),
+              block_size(static_cast<std::ptrdiff_t>(block_size)),
+              gap(static_cast<std::ptrdiff_t>(gap)),
+              cache(std::move(cache)),
+              id(this->cache->register_source())
+        {}
+        state() = delete;
+        state(const state&) = delete;
+        state(state&&) = delete;
+        state& operator=(const state&) = delete;
+        state& operator=(state&&) = delete;
+        ~state() { cache->erase_source(id); }
+
+        Transport transport;
+        std::size_t size;
+        std::ptrdiff_t block_size;
+        std::ptrdiff_t gap;
+        std::shared_ptr<block_cache> cache;
+        std::uint64_t id;
+        std::atomic<int> prefetches{0};
+    };
+
+    /// \returns The sorted indices of all blocks overlapping `ranges`.
+    std::vector<std::ptrdiff_t> blocks_of(gsl::span<const byte_range> ranges) const
+    {
+        std::vector<std::ptrdiff_t> needed;
+        for (const auto& range : ranges) {
+            if (range.begin == range.end) { continue; }
+            for (auto idx = range.begin / state_->block_size;
+                 idx <= (range.end - 1) / state_->block_size;
+                 ++idx) {
+                needed.push_back(idx);
+            }
+        }
+        std::sort(needed.begin(), needed.end());
+        needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+        return needed;
+    }
+
+    /// \returns The blocks with the given sorted indices, issuing one
+    ///          request per run of missing blocks. A run never spans a
+    ///          cached block, and every block is kept in its own buffer, so
+    ///          that evicting it frees its memory.
+    static std::vector<std::shared_ptr<cached_block>>
+    load(state& state, const std::vector<std::ptrdiff_t>& needed)
+    {
+        std::vector<std::shared_ptr<cached_block>> blocks(needed.size());
+        std::vector<std::size_t> missing;
+        for (std::size_t pos = 0; pos < needed.size(); ++pos) {
+            blocks[pos] = state.cache->find({state.id, static_cast<std::uint64_t>(needed[pos])});
+            if (blocks[pos] == nullptr) { missing.push_back(pos); }
+        }
+        auto start = [&state](auto idx) { return idx * state.block_size; };
+        auto stop = [&state](auto idx) {
+            return std::min((idx + 1) * state.block_size,
+                            static_cast<std::ptrdiff_t>(state.size));
+        };
+        auto cached_between = [&state](auto first, auto last) {
+            for (auto idx = first + 1; idx < last; ++idx) {
+                if (state.cache->contains({state.id, static_cast<std::uint64_t>(idx)})) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (auto first = missing.begin(); first != missing.end();) {
+            auto last = std::next(first);
+            while (last != missing.end()
+                   && start(needed[*last]) - stop(needed[*std::prev(last)]) <= state.gap
+                   && !cached_between(needed[*std::prev(last)], needed[*last])) {
+                ++last;
+            }
+            auto run_first = needed[*first];
+            auto run_last = needed[*std::prev(last)];
+            auto begin = start(run_first);
+            auto end = stop(run_last);
+            auto buffer = detail::pooled_slice::make(begin, end);
+            state.transport.get(begin, end, buffer.data);
+            // Blocks between missing ones are fetched anyway, so cache them
+            // too; the cache keeps any copy it already has.
+            for (auto idx = run_first; idx <= run_last; ++idx) {
+                auto data = buffer;
+                if (run_first != run_last) {
+                    data = detail::pooled_slice::make(start(idx), stop(idx));
+                    MEMORY_VIEW_TRACE(bytes_copied, stop(idx) - start(idx));
+                    std::copy(std::next(buffer.data, start(idx) - begin),
+                              std::next(buffer.data, stop(idx) - begin),
+                              data.data);
+                }
+                auto block = std::make_shared<cached_block>(
+                    data, stop(idx) - start(idx), start(idx));
+                block = state.cache->insert({state.id, static_cast<std::uint64_t>(idx)},
+                                            std::move(block));
+                auto pos = std::lower_bound(needed.begin(), needed.end(), idx);
+                if (pos != needed.end() && *pos == idx) {
+                    blocks[pos - needed.begin()] = std::move(block);
+                }
+            }
+            first = last;
+        }
+        return blocks;
+    }
+
+    slice_data serve(std::ptrdiff_t begin,
+                     std::ptrdiff_t end,
+                     const std::vector<std::ptrdiff_t>& needed,
+                     const std::vector<std::shared_ptr<cached_block>>& blocks) const
+    {
+        auto block_size = state_->block_size;
+        return detail::slice_blocks(
+            begin,
+            end,
+            begin / block_size,
+            (end - 1) / block_size,
+            [block_size](auto idx) { return idx * block_size; },
+            [&](auto idx) {
+                auto pos = std::lower_bound(needed.begin(), needed.end(), idx);
+                return blocks[pos - needed.begin()];
+            });
+    }
+
+    std::shared_ptr<state> state_ = nullptr;
+};
+
+/// Handler keeping a fetched memory view, and thus its data, alive.
+class view_handler : public base_handler {
+public:
+    explicit view_handler(memory_view view) : view_(std::move(view)) {}
+    const memory_view& view() const { return view_; }
+
+private:
+    memory_view view_;
+};
+
+/// Memory source joining several memory views into one address space.
+///
+/// A slice within a single chunk points directly into that chunk; only
+/// slices that cross chunk boundaries are copied into a new buffer.
+/// Use `memory_view::segments()` to access a range chunk by chunk without
+/// any copying, e.g., to build an `iovec` array.
+class chained_memory_source {
+public:
+    explicit chained_memory_source(std::vector<memory_view> chunks)
+        : state_(std::make_shared<state>())
+    {
+        state_->starts.reserve(chunks.size() + 1);
+        state_->starts.push_back(0);
+        for (auto& chunk : chunks) {
+            if (chunk.empty()) { continue; }
+            state_->starts.push_back(state_->starts.back() + chunk.size());
+            state_->chunks.push_back(std::move(chunk));
+        }
+    }
+
+    /// Creates an empty chain.
+    chained_memory_source() : chained_memory_source(std::vector<memory_view>{}) {}
+    ~chained_memory_source() = default;
+    chained_memory_source(const chained_memory_source&) = default;
+    chained_memory_source(chained_memory_source&&) = default;
+    chained_memory_source& operator=(const chained_memory_source&) = default;
+    chained_memory_source& operator=(chained_memory_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end) { return {nullptr, nullptr}; }
+        auto first = chunk_of(begin);
+        auto last = chunk_of(end - 1);
+        const auto& starts = state_->starts;
+        if (first == last) {
+            auto part = state_->chunks[first](begin - starts[first], end - starts[first]);
+            const char* ptr = part.as_ptr();
+            return {ptr,
+                    std::allocate_shared<view_handler>(
+                        pool_allocator<view_handler>(buffer_pool::global()),
+                        std::move(part))};
+        }
+        auto handler = pooled_handler::make(end - begin);
+        char* out = handler->data();
+        for (const auto& part : segments(begin, end)) {
+            auto span = part.as_span<char>();
+            MEMORY_VIEW_TRACE(bytes_copied, span.size());
+            out = std::copy(span.begin(), span.end(), out);
+        }
+        return {handler->data(), handler};
+    }
+
+    /// \returns Views of the parts of `[begin, end)` within each chunk.
+    std::vector<memory_view> segments(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        std::vector<memory_view> parts;
+        if (begin == end) { return parts; }
+        const auto& starts = state_->starts;
+        for (auto idx = chunk_of(begin); idx <= chunk_of(end - 1); ++idx) {
+            auto from = std::max(begin, starts[idx]) - starts[idx];
+            auto to = std::min(end, starts[idx + 1]) - starts[idx];
+            parts.push_back(state_->chunks[idx](from, to));
+        }
+        return parts;
+    }
+
+    std::size_t size() const { return state_->starts.back(); }
+
+private:
+    struct state {
+        std::vector<memory_view> chunks;
+        std::vector<std::ptrdiff_t> starts;
+    };
+
+    std::ptrdiff_t chunk_of(std::ptrdiff_t pos) const
+    {
+        const auto& starts = state_->starts;
+        return std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+    }
+
+    std::shared_ptr<state> state_ = nullptr;
+};
+
+/// A growable in-memory buffer for serializing data of unknown size.
+///
+/// Data is appended in chunks that are never moved, so views returned by
+/// `append()` stay valid and writable while the buffer grows, e.g., to
+/// fill in a header once the size of the payload is known.
+/// This class is not thread-safe.
+class growable_buffer {
+public:
+    /// \param chunk_size  Size of the first chunk; each next one is twice
+    ///                    as large, or as large as the appended range.
+    explicit growable_buffer(std::size_t chunk_size = 1u << 16)
+        : next_chunk_size_(std::max<std::size_t>(chunk_size, 1))
+    {}
+
+    ~growable_buffer() = default;
+    growable_buffer(const growable_buffer&) = delete;
+    growable_buffer(growable_buffer&&) = default;
+    growable_buffer& operator=(const growable_buffer&) = delete;
+    growable_buffer& operator=(growable_buffer&&) = default;
+
+    /// Appends `size` uninitialized bytes and returns a view of them.
+    mutable_memory_view append(std::size_t size)
+    {
+        if (chunks_.empty() || chunks_.back().used + size > chunks_.back().handler->size()) {
+            auto chunk_size = std::max(next_chunk_size_, size);
+            chunks_.push_back({pooled_handler::make(chunk_size), 0});
+            next_chunk_size_ = chunk_size * 2;
+        }
+        auto& chunk = chunks_.back();
+        auto offset = static_cast<std::ptrdiff_t>(chunk.used);
+        chunk.used += size;
+        size_ += size;
+        return mutable_memory_view(detail::pooled_buffer_source{chunk.handler, offset, size});
+    }
+
+    /// \returns The number of appended bytes.
+    std::size_t size() const { return size_; }
+
+    /// Returns a read-only view of all data appended so far, which keeps
+    /// it alive. The view is contiguous unless the data spans several
+    /// chunks, in which case it is a `chained_memory_source`.
+    memory_view view() const
+    {
+        std::vector<memory_view> parts;
+        for (const auto& chunk : chunks_) {
+            if (chunk.used > 0) {
+                parts.push_back(mutable_memory_view(
+                    detail::pooled_buffer_source{chunk.handler, 0, chunk.used}));
+            }
+        }
+        if (parts.empty()) { return memory_view(); }
+        if (parts.size() == 1) { return parts.front(); }
+        return memory_view(chained_memory_source(std::move(parts)));
+    }
+
+private:
+    struct chunk {
+        std::shared_ptr<pooled_handler> handler;
+        std::size_t used;
+    };
+
+    std::vector<chunk> chunks_{};
+    std::size_t size_ = 0;
+    std::size_t next_chunk_size_ = 0;
+};
+
+/// Fetch counters collected by `instrumented_source`.
+///
+/// All counters are updated atomically, so one object can be shared by
+/// sources used from several threads; reading them while fetches are in
+/// progress gives a consistent value for each counter, but not a
+/// consistent snapshot of all of them.
+class fetch_stats {
+public:
+    /// The number of latency buckets; bucket `i` counts fetches that took
+    /// less than `2^(i + 1)` nanoseconds, but not less than `2^i`,
+    /// and the last bucket counts all slower ones.
+    static constexpr std::size_t latency_buckets = 40;
+
+    fetch_stats() = default;
+    fetch_stats(const fetch_stats&) = delete;
+    fetch_stats(fetch_stats&&) = delete;
+    fetch_stats& operator=(const fetch_stats&) = delete;
+    fetch_stats& operator=(fetch_stats&&) = delete;
+    ~fetch_stats() = default;
+
+    /// Records a fetch of `bytes` bytes that took `nanoseconds`.
+    void record(std::size_t bytes, std::uint64_t nanoseconds)
+    {
+        fetches_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        std::size_t bucket = 0;
+        while (bucket + 1 < latency_buckets && (nanoseconds >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+        latency_[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Records a batched fetch of several ranges at once.
+    void record_batch() { batches_.fetch_add(1, std::memory_order_relaxed); }
+
+    /// \returns The number of fetched ranges.
+    std::uint64_t fetches() const { return fetches_.load(std::memory_order_relaxed); }
+
+    /// \returns The total number of bytes requested from the source.
+    /// A source merging the ranges of a batch may read fewer.
+    std::uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+    /// \returns The number of calls to `slice_many`.
+    std::uint64_t batches() const { return batches_.load(std::memory_order_relaxed); }
+
+    /// \returns The number of fetches in each latency bucket.
+    std::array<std::uint64_t, latency_buckets> latency_histogram() const
+    {
+        std::array<std::uint64_t, latency_buckets> histogram{};
+        for (std::size_t idx = 0; idx < latency_buckets; ++idx) {
+            histogram[idx] = latency_[idx].load(std::memory_order_relaxed);
+        }
+        return histogram;
+    }
+
+    /// \returns An upper bound, in nanoseconds, on the latency of the
+    ///          given fraction of fetches, e.g., 0.99 for the 99th percentile.
+    std::uint64_t latency_percentile(double fraction) const
+    {
+        auto histogram = latency_histogram();
+        std::uint64_t total = 0;
+        for (auto count : histogram) { total += count; }
+        auto target = static_cast<std::uint64_t>(fraction * total);
+        std::uint64_t seen = 0;
+        for (std::size_t idx = 0; idx < latency_buckets; ++idx) {
+            seen += histogram[idx];
+            if (seen >= target && seen > 0) { return std::uint64_t{2} << idx; }
+        }
+        return 0;
+    }
+
+    void reset()
+    {
+        fetches_.store(0, std::memory_order_relaxed);
+        bytes_.store(0, std::memory_order_relaxed);
+        batches_.store(0, std::memory_order_relaxed);
+        for (auto& bucket : latency_) { bucket.store(0, std::memory_order_relaxed); }
+    }
+
+private:
+    std::atomic<std::uint64_t> fetches_{0};
+    std::atomic<std::uint64_t> bytes_{0};
+    std::atomic<std::uint64_t> batches_{0};
+    std::array<std::atomic<std::uint64_t>, latency_buckets> latency_{};
+};
+
+/// Memory source counting the fetches of another source in `fetch_stats`.
+///
+/// Every call to `slice` or `slice_many` reaching the wrapped source is
+/// a real fetch: accesses served from an already fetched view never get
+/// here. Wrapping a source below a `cached_memory_source` therefore counts
+/// cache misses, and wrapping it above counts all block lookups.
+///
+/// The wrapper forwards all optional methods of `Source`, and it costs
+/// nothing when it is not used, so it can be enabled at compile time with
+/// a type alias, e.g.:
+/// ```
+/// #ifdef COLLECT_STATS
+/// using index_source = mv::instrumented_source<mv::file_memory_source>;
+/// #else
+/// using index_source = mv::file_memory_source;
+/// #endif
+/// ```
+template<typename Source>
+class instrumented_source {
+public:
+    static constexpr bool thread_safe = detail::is_thread_safe<Source>::value;
+
+    explicit instrumented_source(Source source,
+                                 std::shared_ptr<fetch_stats> stats =
+                                     std::make_shared<fetch_stats>())
+        : source_(std::move(source)), stats_(std::move(stats))
+    {}
+
+    instrumented_source() = default;
+    ~instrumented_source() = default;
+    instrumented_source(const instrumented_source&) = default;
+    instrumented_source(instrumented_source&&) = default;
+    instrumented_source& operator=(const instrumented_source&) = default;
+    instrumented_source& operator=(instrumented_source&&) = default;
+
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto data = source_.slice(begin, end);
+        stats_->record(static_cast<std::size_t>(end - begin), elapsed(start));
+        return data;
+    }
+
+    std::size_t size() const { return source_.size(); }
+
+    template<typename S = Source>
+    auto advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+        -> decltype(std::declval<const S&>().advise(begin, end, hint))
+    {
+        return source_.advise(begin, end, hint);
+    }
+
+    template<typename S = Source>
+    auto prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+        -> decltype(std::declval<const S&>().prefetch(begin, end))
+    {
+        return source_.prefetch(begin, end);
+    }
+
+    /// Records the latency of the whole batch for each of its ranges.
+    template<typename S = Source>
+    auto slice_many(gsl::span<const byte_range> ranges, gsl::span<slice_data> out) const
+        -> decltype(std::declval<const S&>().slice_many(ranges, out))
+    {
+        auto start = std::chrono::steady_clock::now();
+        source_.slice_many(ranges, out);
+        auto nanoseconds = elapsed(start);
+        stats_->record_batch();
+        for (const auto& range : ranges) {
+            stats_->record(static_cast<std::size_t>(range.end - range.begin), nanoseconds);
+        }
+    }
+
+    template<typename S = Source>
+    auto segments(std::ptrdiff_t begin, std::ptrdiff_t end) const
+        -> decltype(std::declval<const S&>().segments(begin, end))
+    {
+        return source_.segments(begin, end);
+    }
+
+    template<typename S = Source>
+    auto alignment() const -> decltype(std::declval<const S&>().alignment())
+    {
+        return source_.alignment();
+    }
+
+    const Source& source() const { return source_; }
+    const fetch_stats& stats() const { return *stats_; }
+
+private:
+    static std::uint64_t elapsed(std::chrono::steady_clock::time_point start)
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    Source source_{};
+    std::shared_ptr<fetch_stats> stats_ = std::make_shared<fetch_stats>();
+};
+
+namespace detail {
+
+/// Lookup tables for slicing-by-8: `tables[k][byte]` is the CRC of `byte`
+/// followed by `k` zero bytes.
+inline const std::array<std::array<std::uint32_t, 256>, 8>& crc32c_tables()
+{
+    static const auto tables = []() {
+        std::array<std::array<std::uint32_t, 256>, 8> tables{};
+        for (std::uint32_t idx = 0; idx < 256; ++idx) {
+            auto crc = idx;
+            for (int bit = 0; bit < 8; ++bit) { crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u))); }
+            tables[0][idx] = crc;
+        }
+        for (std::size_t k = 1; k < tables.size(); ++k) {
+            for (std::size_t idx = 0; idx < 256; ++idx) {
+                auto previous = tables[k - 1][idx];
+                tables[k][idx] = (previous >> 8) ^ tables[0][previous & 0xFFu];
+            }
+        }
+        return tables;
+    }();
+    return tables;
+}
+
+/// Updates the inverted CRC32C `state` with a table lookup per byte,
+/// eight bytes at a time.
+inline std::uint32_t crc32c_sliced(const char* data, std::size_t size, std::uint32_t state)
+{
+    const auto& tables = crc32c_tables();
+    for (; size >= 8; data += 8, size -= 8) {
+        auto word = load<std::uint64_t, endian::little>(data) ^ state;
+        state = tables[7][word & 0xFFu] ^ tables[6][(word >> 8) & 0xFFu]
+            ^ tables[5][(word >> 16) & 0xFFu] ^ tables[4][(word >> 24) & 0xFFu]
+            ^ tables[3][(word >> 32) & 0xFFu] ^ tables[2][(word >> 40) & 0xFFu]
+            ^ tables[1][(word >> 48) & 0xFFu] ^ tables[0][word >> 56];
+    }
+    for (; size > 0; ++data, --size) {
+        state = tables[0][(state ^ static_cast<std::uint8_t>(*data)) & 0xFFu] ^ (state >> 8);
+    }
+    return state;
+}
+
+#if (defined(__SSE4_2__) && defined(__x86_64__)) || defined(MEMORY_VIEW_X86_DISPATCH)
+
+/// Updates the inverted CRC32C `state` with the SSE 4.2 CRC instruction.
+MEMORY_VIEW_TARGET("sse4.2")
+inline std::uint32_t crc32c_sse42(const char* data, std::size_t size, std::uint32_t state)
+{
+    std::uint64_t wide = state;
+    for (; size >= 8; data += 8, size -= 8) {
+        wide = _mm_crc32_u64(wide, load<std::uint64_t>(data));
+    }
+    state = static_cast<std::uint32_t>(wide);
+    for (; size > 0; ++data, --size) {
+        state = _mm_crc32_u8(state, static_cast<unsigned char>(*data));
+    }
+    return state;
+}
+
+#endif
+
+}  // namespace detail
+
+/// Computes the CRC32C (Castagnoli) checksum of `size` bytes at `data`,
+/// using the CRC instructions of SSE 4.2, selected at run time on x86-64,
+/// or of ARMv8 if enabled, and slicing-by-8 lookup tables otherwise.
+///
+/// \param crc  Checksum of the preceding bytes, to checksum data in parts.
+inline std::uint32_t crc32c(const char* data, std::size_t size, std::uint32_t crc = 0)
+{
+    std::uint32_t state = ~crc;
+#if (defined(__SSE4_2__) && defined(__x86_64__)) || defined(MEMORY_VIEW_X86_DISPATCH)
+    if (detail::has_sse42()) { return ~detail::crc32c_sse42(data, size, state); }
+#elif defined(__ARM_FEATURE_CRC32) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; data += 8, size -= 8) {
+        state = __crc32cd(state, detail::load<std::uint64_t>(data));
+    }
+    for (; size > 0; ++data, --size) {
+        state = __crc32cb(state, static_cast<std::uint8_t>(*data));
+    }
+    return ~state;
+#endif
+    return ~detail::crc32c_sliced(data, size, state);
+}
+
+/// \returns The CRC32C checksums of consecutive blocks of `block_size` bytes
+///          of `data`, the last of which may be shorter, as expected by
+///          `verified_memory_source`.
+/// \throws std::invalid_argument if `block_size` is zero.
+inline std::vector<std::uint32_t> block_checksums(const memory_view& data, std::size_t block_size)
+{
+    detail::checked_block_size(block_size, "block_checksums");
+    std::vector<std::uint32_t> checksums;
+    auto size = static_cast<std::ptrdiff_t>(data.size());
+    for (std::ptrdiff_t begin = 0; begin < size; begin += block_size) {
+        auto block = data(begin, std::min(begin + static_cast<std::ptrdiff_t>(block_size), size));
+        checksums.push_back(crc32c(block.as_ptr(), block.size()));
+    }
+    return checksums;
+}
+
+/// Thrown when a block of a `verified_memory_source` does not match its
+/// checksum.
+class checksum_error : public std::runtime_error {
+public:
+    explicit checksum_error(std::size_t block)
+        : std::runtime_error("checksum mismatch in block " + std::to_string(block)),
+          block_(block)
+    {}
+
+    checksum_error() = delete;
+    ~checksum_error() override = default;
+    checksum_error(const checksum_error&) = default;
+    checksum_error(checksum_error&&) = default;
+    checksum_error& operator=(const checksum_error&) = default;
+    checksum_error& operator=(checksum_error&&) = default;
+
+    /// \returns The index of the corrupted block.
+    std::size_t block() const { return block_; }
+
+private:
+    std::size_t block_ = 0;
+};
+
+/// Source wrapper checking the integrity of the data of `Source` lazily:
+/// each block is verified against its CRC32C checksum the first time it is
+/// fetched, so that only blocks that are actually read are paid for.
+///
+/// Verified blocks are remembered, and shared by all copies of the source.
+/// A slice overlapping blocks not verified yet is fetched as whole blocks,
+/// so that its data is read only once. Sources exposing their memory
+/// directly through `segments()` would bypass verification, so segments
+/// are not forwarded.
+template<typename Source>
+class verified_memory_source {
+public:
+    /// \param checksums  Checksum of each block, computed with
+    ///                   `block_checksums()`.
+    /// \throws std::invalid_argument if `block_size` is zero.
+    /// \throws std::runtime_error if there is not one checksum per block.
+    verified_memory_source(Source source,
+                           std::size_t block_size,
+                           std::vector<std::uint32_t> checksums)
+        : source_(std::move(source)),
+          state_(std::make_shared<state>(
+              detail::checked_block_size(block_size, "verified_memory_source"),
+              std::move(checksums)))
+    {
+        if (state_->checksums.size() != (source_.size() + block_size - 1) / block_size) {
+            throw std::runtime_error("verified_memory_source: wrong number of checksums");
+        }
+    }
+
+    verified_memory_source() = default;
+    ~verified_memory_source() = default;
+    verified_memory_source(const verified_memory_source&) = default;
+    verified_memory_source(verified_memory_source&&) = default;
+    verified_memory_source& operator=(const verified_memory_source&) = default;
+    verified_memory_source& operator=(verified_memory_source&&) = default;
+
+    /// \throws checksum_error if a block of the slice is corrupted.
+    const slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        if (begin == end || verified(begin, end)) { return source_.slice(begin, end); }
+        auto cover = covering(begin, end);
+        auto data = source_.slice(cover.begin, cover.end);
+        verify(cover, data.ptr);
+        return {std::next(data.ptr, begin - cover.begin), std::move(data.handler)};
+    }
+
+    /// Fetches all `ranges` with a single call to the underlying
+    /// `slice_many`, expanded to whole blocks where needed.
+    template<typename S = Source>
+    auto slice_many(gsl::span<const byte_range> ranges, gsl::span<slice_data> out) const
+        -> decltype(std::declval<const S&>().slice_many(ranges, out))
+    {
+        std::vector<byte_range> covers(ranges.begin(), ranges.end());
+        std::vector<bool> unverified(ranges.size(), false);
+        for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+            const auto& range = ranges[idx];
+            if (range.begin != range.end && !verified(range.begin, range.end)) {
+                covers[idx] = covering(range.begin, range.end);
+                unverified[idx] = true;
+            }
+        }
+        source_.slice_many(covers, out);
+        for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(ranges.size()); ++idx) {
+            if (!unverified[idx]) { continue; }
+            verify(covers[idx], out[idx].ptr);
+            out[idx].ptr = std::next(out[idx].ptr, ranges[idx].begin - covers[idx].begin);
+        }
+    }
+
+    std::size_t size() const { return source_.size(); }
+
+    template<typename S = Source>
+    auto advise(std::ptrdiff_t begin, std::ptrdiff_t end, access_hint hint) const
+        -> decltype(std::declval<const S&>().advise(begin, end, hint))
+    {
+        return source_.advise(begin, end, hint);
+    }
+
+    template<typename S = Source>
+    auto prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+        -> decltype(std::declval<const S&>().prefetch(begin, end))
+    {
+        return source_.prefetch(begin, end);
+    }
+
+    /// Expanded slices start at the beginning of a block of the underlying
+    /// source, which keeps its alignment.
+    template<typename S = Source>
+    auto alignment() const -> decltype(std::declval<const S&>().alignment())
+    {
+        return source_.alignment();
+    }
+
+    /// \returns Whether the block with index `block` has been verified.
+    bool verified(std::size_t block) const
+    {
+        return (state_->verified[block / 64].load(std::memory_order_acquire)
+                >> (block % 64) & 1u) != 0;
+    }
+
+    const Source& source() const { return source_; }
+
+private:
+    struct state {
+        state(std::size_t block_size, std::vector<std::uint32_t> checksums)
+            : block_size(block_size),
+              checksums(std::move(checksums)),
+              verified(new std::atomic<std::uint64_t>[this->checksums.size() / 64 + 1]{})
+        {}
+        state() = delete;
+        state(const state&) = delete;
+        state(state&&) = delete;
+        state& operator=(const state&) = delete;
+        state& operator=(state&&) = delete;
+        ~state() = default;
+
+        std::size_t block_size;
+        std::vector<std::uint32_t> checksums;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> verified;
+    };
+
+    bool verified(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        auto block_size = static_cast<std::ptrdiff_t>(state_->block_size);
+        for (auto block = begin / block_size; block <= (end - 1) / block_size; ++block) {
+            if (!verified(static_cast<std::size_t>(block))) { return false; }
+        }
+        return true;
+    }
+
+    /// \returns The range of the whole blocks overlapping `[begin, end)`.
+    byte_range covering(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        auto block_size = static_cast<std::ptrdiff_t>(state_->block_size);
+        return {begin - begin % block_size,
+                std::min(((end - 1) / block_size + 1) * block_size,
+                         static_cast<std::ptrdiff_t>(size()))};
+    }
+
+    /// Verifies the blocks of `cover`, whose data starts at `data`.
+    void verify(byte_range cover, const char* data) const
+    {
+        auto block_size = static_cast<std::ptrdiff_t>(state_->block_size);
+        for (auto begin = cover.begin; begin < cover.end; begin += block_size) {
+            auto block = static_cast<std::size_t>(begin / block_size);
+            if (verified(block)) { continue; }
+            auto length = static_cast<std::size_t>(std::min(block_size, cover.end - begin));
+            if (crc32c(std::next(data, begin - cover.begin), length) != state_->checksums[block]) {
+                throw checksum_error(block);
+            }
+            state_->verified[block / 64].fetch_or(std::uint64_t{1} << (block % 64),
+                                                  std::memory_order_release);
+        }
+    }
+
+    Source source_{};
+    std::shared_ptr<state> state_ = nullptr;
+};
+
+/// Reads a memory view sequentially, front to back.
+///
+/// If the data of the view is already available, e.g., for static memory
+/// or a view that was accessed before, reading only advances a pointer.
+/// Otherwise, the cursor fetches a window of `window_size` bytes at a time,
+/// so that each byte of a lazy source is fetched once, instead of fetching
+/// the entire remainder at every step as `unpack_head` does.
+class memory_cursor {
+public:
+    explicit memory_cursor(memory_view view, std::size_t window_size = 1u << 16)
+        : view_(std::move(view)), window_size_(window_size)
+    {
+        if (view_.slice_.ptr != nullptr || view_.self_ == nullptr) {
+            window_ = view_;
+            window_end_ = view_.size();
+            window_ptr_ = window_.as_ptr();
+        }
+    }
+
+    memory_cursor() = default;
+    ~memory_cursor() = default;
+    memory_cursor(const memory_cursor&) = default;
+    memory_cursor(memory_cursor&&) noexcept = default;
+    memory_cursor& operator=(const memory_cursor&) = default;
+    memory_cursor& operator=(memory_cursor&&) noexcept = default;
+
+    /// Reads a value of type `T` and advances past it.
+    ///
+    /// \throws std::out_of_range if fewer than `sizeof(T)` bytes remain.
+    template<typename T>
+    T read()
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "T must be trivially copyable");
+        T value;
+        std::memcpy(&value, advance(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    /// Reads `length` bytes as a memory view and advances past them.
+    ///
+    /// Views that fit in a window share its data; longer views are
+    /// returned unfetched.
+    ///
+    /// \throws std::out_of_range if fewer than `length` bytes remain.
+    memory_view read_view(std::size_t length)
+    {
+        check(length);
+        if (length > window_size_ && position_ + length > window_end_) {
+            auto view = view_(position_, position_ + length);
+            position_ += length;
+            return view;
+        }
+        advance(length);
+        return window_(position_ - length - window_begin_,
+                       position_ - window_begin_);
+    }
+
+    /// Reads a record prefixed with its length of type `Length`.
+    template<typename Length>
+    memory_view read_record()
+    {
+        return read_view(static_cast<std::size_t>(read<Length>()));
+    }
+
+    /// Advances by `length` bytes without accessing them.
+    void skip(std::size_t length)
+    {
+        check(length);
+        position_ += length;
+    }
+
+    /// \returns The number of bytes read so far.
+    std::size_t position() const { return position_; }
+
+    /// \returns The number of bytes left to read.
+    std::size_t remaining() const { return view_.size() - position_; }
+
+    /// Equivalent to `remaining() == 0`.
+    bool done() const { return remaining() == 0; }
+
+    /// \returns The unread part of the view.
+    memory_view rest() const { return view_(position_, mv::end); }
+
+private:
+    void check(std::size_t length) const
+    {
+        if (length > remaining()) {
+            throw std::out_of_range("memory_cursor: read past the end");
+        }
+    }
+
+    /// Makes sure the next `length` bytes are in the window, and
+    /// returns a pointer to them.
+    const char* advance(std::size_t length)
+    {
+        check(length);
+        if (position_ + length > window_end_) {
+            window_begin_ = position_;
+            window_end_ = std::min(
+                view_.size(), position_ + std::max(length, window_size_));
+            window_ = view_(window_begin_, window_end_);
+            window_ptr_ = window_.as_ptr();
+        }
+        const char* ptr = std::next(window_ptr_, position_ - window_begin_);
+        position_ += length;
+        return ptr;
+    }
+
+    memory_view view_;
+    memory_view window_;
+    const char* window_ptr_ = nullptr;
+    std::size_t window_size_ = 0;
+    std::size_t window_begin_ = 0;
+    std::size_t window_end_ = 0;
+    std::size_t position_ = 0;
+};
+
+namespace detail {
+
+/// Stores 16 single-byte values widened to `T`.
+template<typename T>
+void widen_bytes(const std::uint8_t* in, T* out)
+{
+#if defined(__SSE2__)
+    if constexpr (sizeof(T) == 4) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        auto* dst = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(high, zero));
+        return;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if constexpr (sizeof(T) == 4) {
+        uint8x16_t bytes = vld1q_u8(in);
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        auto* dst = reinterpret_cast<std::uint32_t*>(out);
+        vst1q_u32(dst, vmovl_u16(vget_low_u16(low)));
+        vst1q_u32(dst + 4, vmovl_u16(vget_high_u16(low)));
+        vst1q_u32(dst + 8, vmovl_u16(vget_low_u16(high)));
+        vst1q_u32(dst + 12, vmovl_u16(vget_high_u16(high)));
+        return;
+    }
+#endif
+    for (int idx = 0; idx < 16; ++idx) {
+        out[idx] = in[idx];
+    }
+}
+
+/// Returns a mask of the bytes among the next 16 that have the
+/// continuation bit set, or -1 if it cannot be computed cheaply.
+inline int continuation_mask(const std::uint8_t* in)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return vmaxvq_u8(vld1q_u8(in)) < 0x80 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+/// Decodes leading runs of 16 single-byte values, and then any further
+/// single-byte values, until a longer value or fewer than 16 input bytes
+/// or output slots are left.
+///
+/// \returns The number of bytes consumed and the number of values decoded.
+template<typename T>
+std::pair<std::size_t, std::size_t> decode_single_byte_runs(const std::uint8_t* in,
+                                                            std::size_t in_size,
+                                                            T* out,
+                                                            std::size_t out_size)
+{
+    std::size_t pos = 0;
+    std::size_t count = 0;
+    while (in_size - pos >= 16 && out_size - count >= 16) {
+        int mask = continuation_mask(in + pos);
+        if (mask == 0) {
+            widen_bytes(in + pos, out + count);
+            pos += 16;
+            count += 16;
+            continue;
+        }
+        while (mask > 0 && (mask & 1) == 0) {
+            out[count++] = in[pos++];
+            mask >>= 1;
+        }
+        break;
+    }
+    return {pos, count};
+}
+
+/// One step of the masked VByte kernels: how to decode the values that
+/// begin in the next 12 bytes, given their continuation bits.
+struct varint_step {
+    /// The number of decoded values: 6 values of at most 2 bytes, each
+    /// shuffled into a 16-bit lane, 4 values of at most 3 bytes, each
+    /// shuffled into a 32-bit lane, or 0 if a longer value comes first.
+    std::uint8_t values;
+    std::uint8_t consumed;
+    std::uint8_t shuffle;
+};
+
+/// Lookup tables of the masked VByte kernels (Plaisance, Kurz, and Lemire,
+/// "Vectorized VByte Decoding"), indexed by the continuation bits of
+/// 12 bytes. Shuffles are identified by the lengths of the values they
+/// gather: 64 combinations of 6 values, then 81 combinations of 4 values.
+struct varint_tables {
+    std::array<varint_step, 4096> steps;
+    std::array<std::array<std::uint8_t, 16>, 64 + 81> shuffles;
+};
+
+inline const varint_tables& masked_vbyte_tables()
+{
+    static const auto tables = []() {
+        varint_tables tables{};
+        for (unsigned mask = 0; mask < 4096; ++mask) {
+            std::array<unsigned, 12> lengths{};
+            unsigned values = 0;
+            unsigned begin = 0;
+            for (unsigned end = 0; end < 12; ++end) {
+                if (((mask >> end) & 1u) == 0) {
+                    lengths[values++] = end + 1 - begin;
+                    begin = end + 1;
+                }
+            }
+            auto fits = [&](unsigned count, unsigned longest) {
+                return values >= count
+                    && std::all_of(lengths.begin(), lengths.begin() + count, [&](auto length) {
+                           return length <= longest;
+                       });
+            };
+            unsigned lanes = fits(6, 2) ? 6 : fits(4, 3) ? 4 : 0;
+            auto& step = tables.steps[mask];
+            step = {0, 0, 0};
+            if (lanes == 0) { continue; }
+            unsigned id = 0;
+            for (unsigned idx = lanes; idx-- > 0;) {
+                id = id * (lanes == 6 ? 2 : 3) + lengths[idx] - 1;
+            }
+            if (lanes == 4) { id += 64; }
+            auto& shuffle = tables.shuffles[id];
+            shuffle.fill(0x80);
+            unsigned width = 16 / (lanes == 6 ? 8 : 4);
+            unsigned consumed = 0;
+            for (unsigned idx = 0; idx < lanes; ++idx) {
+                for (unsigned byte = 0; byte < lengths[idx]; ++byte) {
+                    shuffle[idx * width + byte] = static_cast<std::uint8_t>(consumed++);
+                }
+            }
+            step = {static_cast<std::uint8_t>(lanes),
+                    static_cast<std::uint8_t>(consumed),
+                    static_cast<std::uint8_t>(id)};
+        }
+        return tables;
+    }();
+    return tables;
+}
+
+#if defined(__SSSE3__) || defined(MEMORY_VIEW_X86_DISPATCH)
+
+/// Stores the first `count`, either 2 or 4, 32-bit lanes of `values`
+/// widened to `T`.
+template<typename T>
+void store_lanes(__m128i values, T* out, int count)
+{
+    auto* dst = reinterpret_cast<__m128i*>(out);
+    if constexpr (sizeof(T) == 4) {
+        if (count == 4) {
+            _mm_storeu_si128(dst, values);
+        } else {
+            _mm_storel_epi64(dst, values);
+        }
+    } else {
+        __m128i zero = _mm_setzero_si128();
+        _mm_storeu_si128(dst, _mm_unpacklo_epi32(values, zero));
+        if (count == 4) { _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(values, zero)); }
+    }
+}
+
+/// The SSSE3 masked VByte kernel for 32 and 64-bit values; see
+/// `decode_single_byte_runs()` for when it stops.
+template<typename T>
+MEMORY_VIEW_TARGET("ssse3")
+std::pair<std::size_t, std::size_t> decode_varints_ssse3(const std::uint8_t* in,
+                                                         std::size_t in_size,
+                                                         T* out,
+                                                         std::size_t out_size)
+{
+    const auto& tables = masked_vbyte_tables();
+    std::size_t pos = 0;
+    std::size_t count = 0;
+    while (in_size - pos >= 16 && out_size - count >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+        if (mask == 0) {
+            widen_bytes(in + pos, out + count);
+            pos += 16;
+            count += 16;
+            continue;
+        }
+        const auto& step = tables.steps[mask & 0xFFFu];
+        if (step.values == 0) { break; }
+        __m128i lanes = _mm_shuffle_epi8(
+            bytes,
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.shuffles[step.shuffle].data())));
+        if (step.values == 6) {
+            __m128i words = _mm_or_si128(
+                _mm_and_si128(lanes, _mm_set1_epi16(0x7F)),
+                _mm_srli_epi16(_mm_and_si128(lanes, _mm_set1_epi16(0x7F00)), 1));
+            __m128i zero = _mm_setzero_si128();
+            store_lanes(_mm_unpacklo_epi16(words, zero), out + count, 4);
+            store_lanes(_mm_unpackhi_epi16(words, zero), out + count + 4, 2);
+        } else {
+            __m128i values = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_and_si128(lanes, _mm_set1_epi32(0x7F)),
+                    _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x7F00)), 1)),
+                _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x7F0000)), 2));
+            store_lanes(values, out + count, 4);
+        }
+        pos += step.consumed;
+        count += step.values;
+    }
+    return {pos, count};
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+/// Stores the first `count`, either 2 or 4, 32-bit lanes of `values`
+/// widened to `T`.
+template<typename T>
+void store_lanes(uint32x4_t values, T* out, int count)
+{
+    if constexpr (sizeof(T) == 4) {
+        auto* dst = reinterpret_cast<std::uint32_t*>(out);
+        if (count == 4) {
+            vst1q_u32(dst, values);
+        } else {
+            vst1_u32(dst, vget_low_u32(values));
+        }
+    } else {
+        auto* dst = reinterpret_cast<std::uint64_t*>(out);
+        vst1q_u64(dst, vmovl_u32(vget_low_u32(values)));
+        if (count == 4) { vst1q_u64(dst + 2, vmovl_u32(vget_high_u32(values))); }
+    }
+}
+
+/// The NEON masked VByte kernel for 32 and 64-bit values; see
+/// `decode_single_byte_runs()` for when it stops.
+template<typename T>
+std::pair<std::size_t, std::size_t> decode_varints_neon(const std::uint8_t* in,
+                                                        std::size_t in_size,
+                                                        T* out,
+                                                        std::size_t out_size)
+{
+    const auto& tables = masked_vbyte_tables();
+    const int8x16_t bit_of_byte = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7};
+    std::size_t pos = 0;
+    std::size_t count = 0;
+    while (in_size - pos >= 16 && out_size - count >= 16) {
+        uint8x16_t bytes = vld1q_u8(in + pos);
+        uint8x16_t bits = vshlq_u8(vshrq_n_u8(bytes, 7), bit_of_byte);
+        unsigned mask = vaddv_u8(vget_low_u8(bits))
+            | (static_cast<unsigned>(vaddv_u8(vget_high_u8(bits))) << 8);
+        if (mask == 0) {
+            widen_bytes(in + pos, out + count);
+            pos += 16;
+            count += 16;
+            continue;
+        }
+        const auto& step = tables.steps[mask & 0xFFFu];
+        if (step.values == 0) { break; }
+        uint8x16_t lanes = vqtbl1q_u8(bytes, vld1q_u8(tables.shuffles[step.shuffle].data()));
+        if (step.values == 6) {
+            uint16x8_t words = vreinterpretq_u16_u8(lanes);
+            words = vorrq_u16(vandq_u16(words, vdupq_n_u16(0x7F)),
+                              vshrq_n_u16(vandq_u16(words, vdupq_n_u16(0x7F00)), 1));
+            store_lanes(vmovl_u16(vget_low_u16(words)), out + count, 4);
+            store_lanes(vmovl_u16(vget_high_u16(words)), out + count + 4, 2);
+        } else {
+            uint32x4_t values = vreinterpretq_u32_u8(lanes);
+            values = vorrq_u32(
+                vorrq_u32(vandq_u32(values, vdupq_n_u32(0x7F)),
+                          vshrq_n_u32(vandq_u32(values, vdupq_n_u32(0x7F00)), 1)),
+                vshrq_n_u32(vandq_u32(values, vdupq_n_u32(0x7F0000)), 2));
+            store_lanes(values, out + count, 4);
+        }
+        pos += step.consumed;
+        count += step.values;
+    }
+    return {pos, count};
+}
+
+#endif
+
+/// Decodes as many values as the best available kernel can.
+/// \returns The number of bytes consumed and the number of values decoded.
+template<typename T>
+std::pair<std::size_t, std::size_t> decode_varint_blocks(const std::uint8_t* in,
+                                                         std::size_t in_size,
+                                                         T* out,
+                                                         std::size_t out_size)
+{
+    if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+#if defined(__SSSE3__) || defined(MEMORY_VIEW_X86_DISPATCH)
+        if (has_ssse3()) { return decode_varints_ssse3(in, in_size, out, out_size); }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        return decode_varints_neon(in, in_size, out, out_size);
+#endif
+    }
+    return decode_single_byte_runs(in, in_size, out, out_size);
+}
+
+/// Decodes LEB128 integers from `in` into `out` until either is exhausted.
+///
+/// Where enough input and output are left, 32 and 64-bit values are
+/// decoded 16 bytes at a time by a masked VByte kernel: with SSSE3,
+/// selected at run time on x86-64, or with NEON on AArch64. Other values,
+/// and CPUs without SSSE3, only widen runs of single-byte values with SSE2.
+///
+/// \returns The number of bytes consumed and the number of values decoded.
+/// \throws std::runtime_error on a truncated or overlong value.
+template<typename T>
+std::pair<std::size_t, std::size_t>
+decode_varints(gsl::span<const std::uint8_t> in, gsl::span<T> out)
+{
+    std::size_t pos = 0;
+    std::size_t count = 0;
+    auto in_size = static_cast<std::size_t>(in.size());
+    auto out_size = static_cast<std::size_t>(out.size());
+    const std::uint8_t* bytes = in.data();
+    while (pos < in_size && count < out_size) {
+        if (in_size - pos >= 16 && out_size - count >= 16) {
+            auto [consumed, decoded] = decode_varint_blocks(
+                bytes + pos, in_size - pos, out.data() + count, out_size - count);
+            pos += consumed;
+            count += decoded;
+            if (pos == in_size || count == out_size) { break; }
+        }
+        T value = 0;
+        unsigned shift = 0;
+        std::uint8_t byte = 0;
+        do {
+            if (pos == in_size || shift >= sizeof(T) * 8) {
+                throw std::runtime_error("invalid varint");
+            }
+            byte = bytes[pos++];
+            value |= static_cast<T>(byte & 0x7Fu) << shift;
+            shift += 7;
+        } while ((byte & 0x80u) != 0);
+        out[count++] = value;
+    }
+    return {pos, count};
+}
+
+}  // namespace detail
+
+/// Decodes a `varint_sequence` block by block into caller buffers.
+template<typename T>
+class varint_decoder {
+public:
+    explicit varint_decoder(gsl::span<const std::uint8_t> bytes) : bytes_(bytes) {}
+
+    /// Decodes the next values into `out`, at most `out.size()` of them.
+    /// \returns The number of decoded values.
+    std::size_t next(gsl::span<T> out)
+    {
+        auto [consumed, count] = detail::decode_varints(bytes_, out);
+        bytes_ = bytes_.subspan(consumed);
+        return count;
+    }
+
+    /// \returns Whether all values have been decoded.
+    bool done() const { return bytes_.empty(); }
+
+private:
+    gsl::span<const std::uint8_t> bytes_;
+};
+
+/// A sequence of unsigned LEB128 variable-byte integers: seven bits per byte,
+/// least significant group first, with the high bit set on all but the
+/// last byte of each value.
+template<typename T>
+class varint_sequence {
+    static_assert(std::is_unsigned<T>::value, "T must be an unsigned integer");
+
+public:
+    explicit varint_sequence(memory_view view) : view_(std::move(view)) {}
+
+    /// \returns The number of encoded values; takes linear time.
+    std::size_t size() const
+    {
+        auto bytes = this->bytes();
+        return std::count_if(
+            bytes.begin(), bytes.end(), [](auto byte) { return byte < 0x80u; });
+    }
+
+    /// Decodes the leading values into `out`, at most `out.size()` of them.
+    /// \returns The number of decoded values.
+    std::size_t decode(gsl::span<T> out) const { return decoder().next(out); }
+
+    /// Decodes all values.
+    /// \throws std::runtime_error if the last value is truncated.
+    std::vector<T> decode() const
+    {
+        std::vector<T> values(size());
+        auto decoder = this->decoder();
+        decoder.next(values);
+        if (!decoder.done()) { throw std::runtime_error("invalid varint"); }
+        return values;
+    }
+
+    varint_decoder<T> decoder() const { return varint_decoder<T>(bytes()); }
+
+private:
+    gsl::span<const std::uint8_t> bytes() const
+    {
+        return view_.as_span<std::uint8_t>();
+    }
+
+    memory_view view_;
+};
+
+/// A sequence of `Bits`-bit integers packed into a little-endian bit stream:
+/// value `i` occupies bits `[i * Bits, (i + 1) * Bits)`, where bit `b` is
+/// bit `b % 8` of byte `b / 8`.
+///
+/// Random access takes constant time.
+template<unsigned Bits, typename T>
+class bitpacked_sequence {
+    static_assert(std::is_unsigned<T>::value, "T must be an unsigned integer");
+    static_assert(Bits >= 1 && Bits <= sizeof(T) * 8, "Bits must fit in T");
+
+public:
+    bitpacked_sequence(memory_view view, std::size_t count)
+        : view_(std::move(view)),
+          data_(reinterpret_cast<const std::uint8_t*>(view_.as_ptr())),
+          bytes_(view_.size()),
+          count_(count)
+    {
+        if ((count * Bits + 7) / 8 > bytes_) {
+            throw std::out_of_range("bitpacked_sequence: view too short");
+        }
+    }
+
+    std::size_t size() const { return count_; }
+
+    T operator[](std::size_t idx) const
+    {
+        auto bit = idx * Bits;
+        auto byte = bit / 8;
+        return byte + 9 <= bytes_ ? extract(byte, bit % 8, fast_load)
+                                  : extract(byte, bit % 8, safe_load);
+    }
+
+    /// Decodes `out.size()` values starting at `first`.
+    void decode(std::size_t first, gsl::span<T> out) const
+    {
+        auto count = static_cast<std::size_t>(out.size());
+        std::size_t idx = 0;
+        // Values whose bytes can all be loaded without a bounds check.
+        std::size_t fast = bytes_ >= 9 ? ((bytes_ - 9) * 8) / Bits + 1 : 0;
+        for (; idx < count && first + idx < fast; ++idx) {
+            auto bit = (first + idx) * Bits;
+            out[idx] = extract(bit / 8, bit % 8, fast_load);
+        }
+        for (; idx < count; ++idx) {
+            out[idx] = (*this)[first + idx];
+        }
+    }
+
+    std::vector<T> decode() const
+    {
+        std::vector<T> values(count_);
+        decode(0, values);
+        return values;
+    }
+
+private:
+    static std::uint64_t fast_load(const std::uint8_t* data, std::size_t, std::size_t byte)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + byte, sizeof(word));
+        return word;
+    }
+
+    static std::uint64_t safe_load(const std::uint8_t* data, std::size_t size, std::size_t byte)
+    {
+        std::uint64_t word = 0;
+        if (byte < size) {
+            std::memcpy(&word, data + byte, std::min<std::size_t>(8, size - byte));
+        }
+        return word;
+    }
+
+    template<typename Load>
+    T extract(std::size_t byte, unsigned shift, Load load) const
+    {
+        std::uint64_t value = load(data_, bytes_, byte) >> shift;
+        if (shift + Bits > 64) {
+            std::uint64_t next = byte + 8 < bytes_ ? data_[byte + 8] : 0;
+            value |= next << (64 - shift);
+        }
+        if constexpr (Bits < 64) {
+            value &= (std::uint64_t(1) << Bits) - 1;
+        }
+        return static_cast<T>(value);
+    }
+
+    memory_view view_;
+    const std::uint8_t* data_ = nullptr;
+    std::size_t bytes_ = 0;
+    std::size_t count_ = 0;
+};
+
+namespace detail {
+
+/// The number of elements a search narrows down to before scanning them.
+constexpr std::size_t linear_search_size = 16;
+
+/// \returns The number of the `linear_search_size` elements at `data`
+///          that are less than `value`.
+template<typename T>
+std::size_t count_less(const T* data, const T& value)
+{
+#if defined(__SSE2__)
+    if constexpr (std::is_integral<T>::value && sizeof(T) == 4) {
+        // Flipping the sign bit turns unsigned comparisons into signed ones.
+        const auto flip = _mm_set1_epi32(std::is_signed<T>::value ? 0 : INT32_MIN);
+        const auto needle = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(value)), flip);
+        auto count = _mm_setzero_si128();
+        for (std::size_t idx = 0; idx < linear_search_size; idx += 4) {
+            auto values = _mm_xor_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + idx)), flip);
+            count = _mm_sub_epi32(count, _mm_cmplt_epi32(values, needle));
+        }
+        count = _mm_add_epi32(count, _mm_shuffle_epi32(count, _MM_SHUFFLE(1, 0, 3, 2)));
+        count = _mm_add_epi32(count, _mm_shuffle_epi32(count, _MM_SHUFFLE(2, 3, 0, 1)));
+        return static_cast<std::size_t>(_mm_cvtsi128_si32(count));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if constexpr (std::is_integral<T>::value && sizeof(T) == 4) {
+        auto count = vdupq_n_u32(0);
+        for (std::size_t idx = 0; idx < linear_search_size; idx += 4) {
+            if constexpr (std::is_signed<T>::value) {
+                auto values = vld1q_s32(reinterpret_cast<const std::int32_t*>(data + idx));
+                count = vsubq_u32(count, vcltq_s32(values, vdupq_n_s32(value)));
+            } else {
+                auto values = vld1q_u32(reinterpret_cast<const std::uint32_t*>(data + idx));
+                count = vsubq_u32(count, vcltq_u32(values, vdupq_n_u32(value)));
+            }
+        }
+        return vaddvq_u32(count);
+    }
+#endif
+    std::size_t count = 0;
+    for (std::size_t idx = 0; idx < linear_search_size; ++idx) {
+        count += data[idx] < value ? 1 : 0;
+    }
+    return count;
+}
+
+}  // namespace detail
+
+namespace detail {
+
+/// \returns The values of `view`, copied into a pooled buffer, which is
+///          then owned by `copy`, if they are not aligned for `T`.
+template<typename T>
+gsl::span<const T> aligned_values(const memory_view& view,
+                                  std::shared_ptr<pooled_handler>& copy)
+{
+    static_assert(alignof(T) <= buffer_pool::alignment, "T is over-aligned");
+    if (view.is_aligned<T>()) { return view.as_span<T>(); }
+    auto count = view.size() / sizeof(T);
+    copy = pooled_handler::make(count * sizeof(T));
+    MEMORY_VIEW_TRACE(bytes_copied, count * sizeof(T));
+    std::copy_n(view.as_ptr(), count * sizeof(T), copy->data());
+    return gsl::span<const T>(reinterpret_cast<const T*>(copy->data()), count);
+}
+
+}  // namespace detail
+
+/// A sorted array of `T` in a view, e.g., the keys of a dictionary.
+///
+/// The data is fetched once, when the view is created.
+template<typename T>
+class sorted_view {
+public:
+    /// Data not aligned to `T` is copied into an aligned buffer.
+    explicit sorted_view(memory_view view)
+        : view_(std::move(view)), values_(detail::aligned_values<T>(view_, copy_))
+    {}
+
+    std::size_t size() const { return static_cast<std::size_t>(values_.size()); }
+    const T& operator[](std::size_t idx) const { return values_[idx]; }
+    gsl::span<const T> values() const { return values_; }
+
+    /// \returns The index of the first value not less than `value`, or
+    ///          `size()` if there is none.
+    ///
+    /// Halves the range without branches, which the processor cannot
+    /// mispredict, then counts the smaller values among the last few with
+    /// SIMD instructions if available.
+    std::size_t lower_bound(const T& value) const
+    {
+        const T* first = values_.data();
+        auto count = size();
+        if (count < detail::linear_search_size) {
+            std::size_t less = 0;
+            for (std::size_t idx = 0; idx < count; ++idx) { less += first[idx] < value ? 1 : 0; }
+            return less;
+        }
+        const T* base = first;
+        auto length = count;
+        while (length > detail::linear_search_size) {
+            auto half = length / 2;
+            base = base[half] < value ? base + half : base;
+            length -= half;
+        }
+        // All values before `base` are less than `value`, and all values
+        // from `base + length` are not, so any window of the scanned size
+        // containing `[base, base + length)` gives the same answer.
+        base = std::min(base, first + count - detail::linear_search_size);
+        return static_cast<std::size_t>(base - first) + detail::count_less(base, value);
+    }
+
+    /// Finds the first value not less than `value` at or after `from`,
+    /// probing at exponentially growing distances first. Faster than
+    /// `lower_bound` for a value close to `from`, e.g., when searching
+    /// for increasing values to intersect sorted lists.
+    ///
+    /// \returns The index of the value, or `size()` if there is none.
+    std::size_t lower_bound(const T& value, std::size_t from) const
+    {
+        auto count = size();
+        std::size_t step = 1;
+        auto low = std::min(from, count);
+        while (low + step < count && values_[low + step] < value) {
+            low += step;
+            step *= 2;
+        }
+        if (low >= count || !(values_[low] < value)) { return low; }
+        auto high = std::min(low + step, count);
+        return static_cast<std::size_t>(
+            std::lower_bound(values_.data() + low + 1, values_.data() + high, value)
+            - values_.data());
+    }
+
+    /// \returns Whether `value` is in the array.
+    bool contains(const T& value) const
+    {
+        auto idx = lower_bound(value);
+        return idx < size() && !(value < values_[idx]);
+    }
+
+private:
+    memory_view view_;
+    std::shared_ptr<pooled_handler> copy_ = nullptr;
+    gsl::span<const T> values_;
+};
+
+namespace detail {
+
+template<typename T>
+void eytzinger_fill(gsl::span<const T> values,
+                    std::vector<T>& layout,
+                    std::size_t& next,
+                    std::size_t node)
+{
+    if (node > layout.size()) { return; }
+    eytzinger_fill(values, layout, next, 2 * node);
+    layout[node - 1] = values[next++];
+    eytzinger_fill(values, layout, next, 2 * node + 1);
+}
+
+}  // namespace detail
+
+/// Reorders sorted `values` into the Eytzinger layout of `eytzinger_view`:
+/// the breadth-first order of an implicit complete binary search tree,
+/// where the children of the value at index `i` are at `2i + 1` and
+/// `2i + 2`. Data associated with the values can be reordered the same
+/// way, so that it shares their positions.
+template<typename T>
+std::vector<T> eytzinger_layout(gsl::span<const T> values)
+{
+    std::vector<T> layout(values.size());
+    std::size_t next = 0;
+    detail::eytzinger_fill(values, layout, next, 1);
+    return layout;
+}
+
+/// An array of `T` in the Eytzinger layout produced by `eytzinger_layout()`.
+///
+/// A search reads the values top to bottom, so the first levels of the
+/// tree, which every search visits, stay in the cache, and the
+/// descendants a few levels down are prefetched while comparing.
+template<typename T>
+class eytzinger_view {
+public:
+    /// Data not aligned to `T` is copied into an aligned buffer.
+    explicit eytzinger_view(memory_view view)
+        : view_(std::move(view)), values_(detail::aligned_values<T>(view_, copy_))
+    {}
+
+    std::size_t size() const { return static_cast<std::size_t>(values_.size()); }
+
+    /// \returns The value at position `pos` of the layout.
+    const T& operator[](std::size_t pos) const { return values_[pos]; }
+
+    /// \returns The position in the layout of the smallest value not less
+    ///          than `value`, or `size()` if there is none.
+    std::size_t lower_bound(const T& value) const
+    {
+        const T* data = values_.data();
+        auto count = size();
+        // The descendants four levels down span 16 consecutive values.
+        constexpr std::size_t prefetch_distance = 16;
+        std::size_t node = 1;
+        while (node <= count) {
+            if (prefetch_distance * node <= count) {
+                detail::prefetch_cache_line(data + prefetch_distance * node - 1);
+            }
+            node = 2 * node + (data[node - 1] < value ? 1 : 0);
+        }
+        // Drops the right turns taken after the last left one.
+        node >>= detail::count_trailing_zeros(~static_cast<std::uint64_t>(node)) + 1;
+        return node == 0 ? count : node - 1;
+    }
+
+    /// \returns Whether `value` is in the array.
+    bool contains(const T& value) const
+    {
+        auto pos = lower_bound(value);
+        return pos < size() && !(value < values_[pos]);
+    }
+
+private:
+    memory_view view_;
+    std::shared_ptr<pooled_handler> copy_ = nullptr;
+    gsl::span<const T> values_;
+};
+
+/// How the record offsets of an `indexed_view` are stored.
+enum class offset_encoding : std::uint64_t {
+    /// One 64-bit integer per offset.
+    plain = 0,
+    /// Elias-Fano coding, which takes about `2 + log(n / u)` bits per
+    /// offset for `n` records of `u` bytes in total.
+    elias_fano = 1
+};
+
+namespace detail {
+
+/// Reads `width` bits at bit `bit` of little-endian 64-bit words at `data`.
+inline std::uint64_t read_bits(const char* data, std::size_t bit, unsigned width)
+{
+    if (width == 0) { return 0; }
+    auto word = bit / 64;
+    auto shift = static_cast<unsigned>(bit % 64);
+    auto value = load<std::uint64_t, endian::little>(data + 8 * word) >> shift;
+    if (shift + width > 64) {
+        value |= load<std::uint64_t, endian::little>(data + 8 * (word + 1)) << (64 - shift);
+    }
+    return width == 64 ? value : value & ((std::uint64_t{1} << width) - 1);
+}
+
+/// Random access to a monotone sequence in Elias-Fano coding: the low
+/// `low_bits` bits of each value are stored verbatim, and the remaining
+/// high bits in unary, as the positions of set bits in a bit vector.
+///
+/// Finding the `i`-th set bit starts from a sample taken every
+/// `sample_rate` set bits, so access takes constant time.
+class elias_fano_offsets {
+public:
+    static constexpr std::size_t sample_rate = 64;
+
+    elias_fano_offsets(const char* low, const char* high, std::size_t high_words, unsigned low_bits)
+        : low_(low), high_(high), low_bits_(low_bits)
+    {
+        std::size_t ones = 0;
+        for (std::size_t word = 0; word < high_words; ++word) {
+            auto bits = load<std::uint64_t, endian::little>(high + 8 * word);
+            auto count = static_cast<std::size_t>(popcount(bits));
+            while (samples_.size() * sample_rate < ones + count) {
+                samples_.push_back({word, ones});
+            }
+            ones += count;
+        }
+        ones_ = ones;
+    }
+
+    elias_fano_offsets() = default;
+    ~elias_fano_offsets() = default;
+    elias_fano_offsets(const elias_fano_offsets&) = default;
+    elias_fano_offsets(elias_fano_offsets&&) = default;
+    elias_fano_offsets& operator=(const elias_fano_offsets&) = default;
+    elias_fano_offsets& operator=(elias_fano_offsets&&) = default;
+
+    /// \returns The number of values.
+    std::size_t size() const { return ones_; }
+
+    std::uint64_t operator[](std::size_t idx) const
+    {
+        auto high = static_cast<std::uint64_t>(select(idx) - idx);
+        return high << low_bits_ | read_bits(low_, idx * low_bits_, low_bits_);
+    }
+
+    /// \returns The values with indices `idx` and `idx + 1`, finding the
+    ///          second one by scanning from the first.
+    std::pair<std::uint64_t, std::uint64_t> pair(std::size_t idx) const
+    {
+        auto position = select(idx);
+        auto word = (position + 1) / 64;
+        auto bits = load<std::uint64_t, endian::little>(high_ + 8 * word)
+            & (~std::uint64_t{0} << ((position + 1) % 64));
+        while (bits == 0) { bits = load<std::uint64_t, endian::little>(high_ + 8 * ++word); }
+        auto next = word * 64 + static_cast<std::size_t>(count_trailing_zeros(bits));
+        return {static_cast<std::uint64_t>(position - idx) << low_bits_
+                    | read_bits(low_, idx * low_bits_, low_bits_),
+                static_cast<std::uint64_t>(next - idx - 1) << low_bits_
+                    | read_bits(low_, (idx + 1) * low_bits_, low_bits_)};
+    }
+
+    /// Encodes the monotone `values` into `out`.
+    /// \returns The number of low bits and of high bit words.
+    static std::pair<unsigned, std::size_t> encode(gsl::span<const std::uint64_t> values,
+                                                   std::string& out)
+    {
+        auto count = static_cast<std::size_t>(values.size());
+        auto universe = count > 0 ? values[count - 1] + 1 : 0;
+        unsigned low_bits = 0;
+        while (count > 0 && (universe >> (low_bits + 1)) >= count) { ++low_bits; }
+        std::vector<std::uint64_t> low(low_words(count, low_bits), 0);
+        auto high_size = (count > 0 ? (universe >> low_bits) : 0) + count + 1;
+        std::vector<std::uint64_t> high((high_size + 63) / 64, 0);
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            auto value = values[idx];
+            if (low_bits > 0) {
+                auto bits = value & ((std::uint64_t{1} << low_bits) - 1);
+                auto bit = idx * low_bits;
+                low[bit / 64] |= bits << (bit % 64);
+                if (bit % 64 + low_bits > 64) { low[bit / 64 + 1] |= bits >> (64 - bit % 64); }
+            }
+            auto position = (value >> low_bits) + idx;
+            high[position / 64] |= std::uint64_t{1} << (position % 64);
+        }
+        for (auto words : {&low, &high}) {
+            for (auto word : *words) {
+                char buffer[8];
+                store<std::uint64_t, endian::little>(buffer, word);
+                out.append(buffer, 8);
+            }
+        }
+        return {low_bits, high.size()};
+    }
+
+    /// \returns The number of low bit words written by `encode()`,
+    ///          including one of padding for reads across words.
+    static std::size_t low_words(std::size_t count, unsigned low_bits)
+    {
+        return (count * low_bits + 63) / 64 + 1;
+    }
+
+private:
+    /// \returns The position of the set bit with index `idx`.
+    std::size_t select(std::size_t idx) const
+    {
+        auto [word, rank] = samples_[idx / sample_rate];
+        while (true) {
+            auto bits = load<std::uint64_t, endian::little>(high_ + 8 * word);
+            auto count = static_cast<std::size_t>(popcount(bits));
+            if (rank + count > idx) {
+                return word * 64 + select_in_word(bits, idx - rank);
+            }
+            rank += count;
+            ++word;
+        }
+    }
+
+    /// \returns The position of the set bit with index `rank` in `bits`.
+    ///
+    /// Finds the byte holding it from the cumulative byte counts computed
+    /// with a multiplication, as proposed by Vigna.
+    static std::size_t select_in_word(std::uint64_t bits, std::size_t rank)
+    {
+        constexpr std::uint64_t ones_step = 0x0101010101010101ull;
+        constexpr std::uint64_t high_bits = 0x8080808080808080ull;
+        auto sums = bits - ((bits >> 1) & 0x5555555555555555ull);
+        sums = (sums & 0x3333333333333333ull) + ((sums >> 2) & 0x3333333333333333ull);
+        sums = ((sums + (sums >> 4)) & 0x0F0F0F0F0F0F0F0Full) * ones_step;
+        auto greater = ((rank * ones_step | high_bits) - sums) & high_bits;
+        auto place = static_cast<unsigned>(((greater >> 7) * ones_step >> 53) & ~std::uint64_t{7});
+        auto skip = rank - ((sums << 8) >> place & 0xFFu);
+        auto byte = (bits >> place) & 0xFFu;
+        for (; skip > 0; --skip) { byte &= byte - 1; }
+        return place + static_cast<std::size_t>(count_trailing_zeros(byte));
+    }
+
+    const char* low_ = nullptr;
+    const char* high_ = nullptr;
+    unsigned low_bits_ = 0;
+    std::size_t ones_ = 0;
+    /// The word holding every `sample_rate`-th set bit, and the number of
+    /// set bits before that word.
+    std::vector<std::pair<std::size_t, std::size_t>> samples_{};
+};
+
+}  // namespace detail
+
+/// Variable-length records in a view, stored after a table of their
+/// offsets, as written by `encode_indexed()`:
+///
+/// - the number of records `n` and the `offset_encoding`, as 64-bit
+///   integers, followed by
+/// - the `n + 1` offsets of the records within the payload, either as
+///   64-bit integers, or as the number of low bits and of high bit words of
+///   their Elias-Fano coding, followed by those words,
+/// - the payload.
+///
+/// All integers are little-endian. The data is fetched once, when the view
+/// is created, so that records are plain spans into it.
+class indexed_view {
+public:
+    /// Iterates over the records in order.
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = gsl::span<const char>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = gsl::span<const char>;
+
+        iterator(const indexed_view* records, std::size_t idx) : records_(records), idx_(idx) {}
+
+        iterator() = default;
+        ~iterator() = default;
+        iterator(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        gsl::span<const char> operator*() const { return (*records_)[idx_]; }
+        iterator& operator++()
+        {
+            ++idx_;
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            auto previous = *this;
+            ++idx_;
+            return previous;
+        }
+        bool operator==(const iterator& other) const { return idx_ == other.idx_; }
+        bool operator!=(const iterator& other) const { return idx_ != other.idx_; }
+
+    private:
+        const indexed_view* records_ = nullptr;
+        std::size_t idx_ = 0;
+    };
+
+    /// Checks that the offsets are increasing and within the payload, in
+    /// time linear in the number of records.
+    ///
+    /// \throws std::runtime_error if the view is not a valid record file.
+    explicit indexed_view(memory_view view) : view_(std::move(view))
+    {
+        auto size = view_.size();
+        const char* data = view_.as_ptr();
+        auto word = [&](std::size_t idx) {
+            if (size < 8 * (idx + 1)) { invalid(); }
+            return detail::load<std::uint64_t, endian::little>(data + 8 * idx);
+        };
+        count_ = word(0);
+        encoding_ = static_cast<offset_encoding>(word(1));
+        std::size_t header = 0;
+        if (encoding_ == offset_encoding::plain) {
+            offsets_ = data + 16;
+            header = 16 + 8 * (count_ + 1);
+            if (count_ >= size / 8 || size < header) { invalid(); }
+        } else if (encoding_ == offset_encoding::elias_fano) {
+            auto low_bits = word(2);
+            auto high_words = word(3);
+            if (low_bits >= 64 || count_ >= size || high_words >= size / 8) { invalid(); }
+            auto low_words = detail::elias_fano_offsets::low_words(
+                count_ + 1, static_cast<unsigned>(low_bits));
+            header = 32 + 8 * (low_words + high_words);
+            if (size < header) { invalid(); }
+            elias_fano_ = detail::elias_fano_offsets(
+                data + 32, data + 32 + 8 * low_words, high_words, static_cast<unsigned>(low_bits));
+            if (elias_fano_.size() != count_ + 1) { invalid(); }
+        } else {
+            invalid();
+        }
+        payload_ = data + header;
+        std::size_t previous = 0;
+        for (std::size_t idx = 0; idx <= count_; ++idx) {
+            auto current = offset(idx);
+            if (current < previous || current > size - header) { invalid(); }
+            previous = current;
+        }
+    }
+
+    indexed_view() = default;
+    ~indexed_view() = default;
+    indexed_view(const indexed_view&) = default;
+    indexed_view(indexed_view&&) = default;
+    indexed_view& operator=(const indexed_view&) = default;
+    indexed_view& operator=(indexed_view&&) = default;
+
+    /// \returns The number of records.
+    std::size_t size() const { return count_; }
+
+    /// \returns The record with index `idx`, in constant time.
+    gsl::span<const char> operator[](std::size_t idx) const
+    {
+        if (encoding_ == offset_encoding::elias_fano) {
+            auto [begin, end] = elias_fano_.pair(idx);
+            return gsl::span<const char>(payload_ + begin, end - begin);
+        }
+        auto begin = offset(idx);
+        return gsl::span<const char>(payload_ + begin, offset(idx + 1) - begin);
+    }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, count_); }
+
+    offset_encoding encoding() const { return encoding_; }
+
+private:
+    [[noreturn]] static void invalid()
+    {
+        throw std::runtime_error("indexed_view: invalid record file");
+    }
+
+    std::size_t offset(std::size_t idx) const
+    {
+        return encoding_ == offset_encoding::plain
+            ? detail::load<std::uint64_t, endian::little>(offsets_ + 8 * idx)
+            : elias_fano_[idx];
+    }
+
+    memory_view view_;
+    std::size_t count_ = 0;
+    offset_encoding encoding_ = offset_encoding::plain;
+    const char* offsets_ = nullptr;
+    detail::elias_fano_offsets elias_fano_{};
+    const char* payload_ = nullptr;
+};
+
+template<typename Derived>
+indexed_view detail::view_interface<Derived>::as_indexed() const
+{
+    return indexed_view(memory_view(self()));
+}
+
+/// Writes `records` in the format read by `indexed_view`.
+///
+/// \tparam Records  A range of contiguous ranges of `char`, such as a
+///                  `std::vector<std::string>`.
+template<typename Records>
+std::string encode_indexed(const Records& records,
+                           offset_encoding encoding = offset_encoding::plain)
+{
+    std::vector<std::uint64_t> offsets{0};
+    for (const auto& record : records) { offsets.push_back(offsets.back() + std::size(record)); }
+    std::string out;
+    auto append = [&out](std::uint64_t value) {
+        char buffer[8];
+        detail::store<std::uint64_t, endian::little>(buffer, value);
+        out.append(buffer, 8);
+    };
+    append(offsets.size() - 1);
+    append(static_cast<std::uint64_t>(encoding));
+    if (encoding == offset_encoding::plain) {
+        for (auto offset : offsets) { append(offset); }
+    } else {
+        std::string words;
+        auto [low_bits, high_words] = detail::elias_fano_offsets::encode(offsets, words);
+        append(low_bits);
+        append(high_words);
+        out += words;
+    }
+    for (const auto& record : records) { out.append(std::data(record), std::size(record)); }
+    return out;
+}
+
+/// Prefetches all `views`; see `memory_view::prefetch()`.
+inline void prefetch(gsl::span<const memory_view> views)
+{
+    for (const auto& view : views) {
+        view.prefetch();
+    }
+}
+
+/// Fetches the data of all `views` that have not been accessed yet.
+///
+/// Views over the same source are fetched with a single call to its
+/// `slice_many`, which lets the source coalesce adjacent or overlapping
+/// ranges. Synchronized views are fetched one by one.
+inline void fetch(gsl::span<memory_view> views)
+{
+    std::vector<memory_view*> pending;
+    for (auto& view : views) {
+        if (view.slice_.ptr != nullptr || view.self_ == nullptr) { continue; }
+        if (view.fetch_ != nullptr) {
+            view.ptr();
+        } else {
+            pending.push_back(&view);
+        }
+    }
+    std::stable_sort(pending.begin(), pending.end(), [](auto lhs, auto rhs) {
+        return std::less<>{}(lhs->self_.get(), rhs->self_.get());
+    });
+    std::vector<byte_range> ranges;
+    std::vector<slice_data> slices;
+    for (auto first = pending.begin(); first != pending.end();) {
+        auto last = std::find_if(first, pending.end(), [&](auto view) {
+            return view->self_ != (*first)->self_;
+        });
+        ranges.clear();
+        for (auto pos = first; pos != last; ++pos) {
+            ranges.push_back({(*pos)->begin_, (*pos)->end_});
+        }
+        slices.assign(ranges.size(), {nullptr, nullptr});
+        (*first)->self_->slice_many(ranges, slices);
+        for (auto pos = first; pos != last; ++pos) {
+            (*pos)->slice_ = std::move(slices[pos - first]);
+        }
+        first = last;
+    }
+}
+
+/// Loads the blocks recorded in `snapshot` into the caches behind `views`,
+/// hottest first.
+///
+/// \param views             Views over cached sources, by the names given
+///                          with `block_cache::name_source()`. Blocks of
+///                          other sources, or past the end of a view, are
+///                          skipped.
+/// \param bytes_per_second  Limit of the loaded bytes per second, or zero
+///                          for no limit.
+inline void warm_up(const cache_snapshot& snapshot,
+                    const std::unordered_map<std::string, memory_view>& views,
+                    std::size_t bytes_per_second = 0)
+{
+    constexpr std::size_t batch_size = 16;
+    auto started = std::chrono::steady_clock::now();
+    std::uint64_t loaded = 0;
+    std::vector<memory_view> batch;
+    for (auto entry = snapshot.entries.begin(); entry != snapshot.entries.end();) {
+        batch.clear();
+        for (; entry != snapshot.entries.end() && batch.size() < batch_size; ++entry) {
+            auto view = views.find(entry->source);
+            std::uint64_t size = view != views.end() ? view->second.size() : 0;
+            if (entry->offset >= size) { continue; }
+            auto end = entry->size > size - entry->offset ? size : entry->offset + entry->size;
+            batch.push_back(view->second(static_cast<std::ptrdiff_t>(entry->offset),
+                                         static_cast<std::ptrdiff_t>(end)));
+            loaded += end - entry->offset;
+        }
+        fetch(gsl::span<memory_view>(batch));
+        if (bytes_per_second > 0) {
+            std::this_thread::sleep_until(
+                started
+                + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(static_cast<double>(loaded) / bytes_per_second)));
+        }
+    }
+}
+
+/// Runs `warm_up()` on a background thread.
+///
+/// \returns A future that becomes ready once all blocks are loaded, and
+///          rethrows any error raised while loading them. Like any future
+///          from `std::async`, it waits for the thread when destroyed.
+inline std::future<void> warm_up_async(cache_snapshot snapshot,
+                                       std::unordered_map<std::string, memory_view> views,
+                                       std::size_t bytes_per_second = 0)
+{
+    return std::async(std::launch::async,
+                      [snapshot = std::move(snapshot), views = std::move(views), bytes_per_second]() {
+                          warm_up(snapshot, views, bytes_per_second);
+                      });
+}
+
+/// Options of `parallel_for_each` and `parallel_reduce`.
+struct parallel_options {
+    /// Number of threads; zero means one per hardware thread.
+    unsigned threads = 0;
+    /// Approximate number of bytes of a chunk, rounded up to a multiple of
+    /// both the element size and a cache line.
+    std::size_t chunk_size = std::size_t{1} << 20;
+};
+
+namespace detail {
+
+template<typename T>
+std::size_t chunk_step(std::size_t chunk_size)
+{
+    auto unit = std::lcm(sizeof(T), std::size_t{64});
+    return std::max<std::size_t>((chunk_size + unit - 1) / unit, 1) * unit;
+}
+
+}  // namespace detail
+
+/// Calls `fn(chunk)` for consecutive sub-views of `view` from multiple
+/// threads, in no particular order. Chunks hold whole elements of type `T`,
+/// except for a trailing partial element, and each chunk is fetched by the
+/// thread that processes it, so lazy sources are read in parallel too.
+/// The source of `view` must therefore support concurrent slicing;
+/// use a single thread for sources such as `istream_memory_source`.
+///
+/// \throws The first exception thrown by `fn`.
+template<typename T = char, typename Fn>
+void parallel_for_each(const memory_view& view, Fn fn, const parallel_options& options = {})
+{
+    detail::parallel_chunks(view.size(),
+                            detail::chunk_step<T>(options.chunk_size),
+                            options.threads,
+                            [&](auto begin, auto end) {
+                                fn(view(static_cast<std::ptrdiff_t>(begin),
+                                        static_cast<std::ptrdiff_t>(end)));
+                            });
+}
+
+/// Reduces `view` in parallel: `map(chunk)` is called for chunks as in
+/// `parallel_for_each`, and the results are folded with `combine` in the
+/// order of the chunks, starting from `init`, so `combine` need not be
+/// commutative. As there, the source of `view` must support concurrent
+/// slicing unless a single thread is used.
+///
+/// \returns `init` if the view is empty.
+/// \throws The first exception thrown by `map`.
+template<typename T = char, typename R, typename Map, typename Combine>
+R parallel_reduce(const memory_view& view,
+                  R init,
+                  Map map,
+                  Combine combine,
+                  const parallel_options& options = {})
+{
+    auto step = detail::chunk_step<T>(options.chunk_size);
+    std::vector<std::optional<R>> partial((view.size() + step - 1) / step);
+    detail::parallel_chunks(view.size(), step, options.threads, [&](auto begin, auto end) {
+        partial[begin / step].emplace(map(view(static_cast<std::ptrdiff_t>(begin),
+                                               static_cast<std::ptrdiff_t>(end))));
+    });
+    for (auto& result : partial) { init = combine(std::move(init), std::move(*result)); }
+    return init;
+}
 
 template<typename Container>
 memory_view make_memory_view(const Container& container)
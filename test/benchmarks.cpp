@@ -0,0 +1,396 @@
+// MIT License
+//
+// Copyright (c) 2018 Michal Siedlaczek
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// \file
+/// \author Michal Siedlaczek
+/// \copyright MIT License
+
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include <memory_view.hpp>
+
+MEMORY_VIEW_TRACE_ALLOCATIONS()
+
+namespace {
+
+constexpr std::size_t file_size = std::size_t(16) << 20;
+constexpr const char* file_name = "bench_file";
+
+const std::vector<char>& data()
+{
+    static std::vector<char> bytes = []() {
+        std::vector<char> bytes(file_size);
+        std::iota(bytes.begin(), bytes.end(), 0);
+        std::ofstream(file_name).write(bytes.data(), bytes.size());
+        return bytes;
+    }();
+    return bytes;
+}
+
+enum class pattern { sequential, random };
+
+/// Offsets of `count` slices of length `length` in the given pattern.
+std::vector<std::ptrdiff_t>
+offsets(std::size_t count, std::size_t length, pattern access)
+{
+    std::vector<std::ptrdiff_t> offsets(count);
+    std::ptrdiff_t slots = file_size / length;
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<std::ptrdiff_t> dist(0, slots - 1);
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        auto slot = access == pattern::sequential ? idx % slots : dist(gen);
+        offsets[idx] = slot * length;
+    }
+    return offsets;
+}
+
+/// Reports allocations per iteration of the calling thread since `before`
+/// was created, as well as its fetches and copies in tracing builds.
+void count_allocations(benchmark::State& state, const mv::trace::scope& before)
+{
+    state.counters["allocs/op"] = benchmark::Counter(
+        static_cast<double>(before.allocations()), benchmark::Counter::kAvgIterations);
+#ifdef MEMORY_VIEW_TRACING
+    state.counters["slices/op"] = benchmark::Counter(
+        static_cast<double>(before.slices()), benchmark::Counter::kAvgIterations);
+    state.counters["copied/op"] = benchmark::Counter(
+        static_cast<double>(before.bytes_copied()), benchmark::Counter::kAvgIterations);
+#endif
+}
+
+mv::memory_view make_view(int source)
+{
+    data();
+    switch (source) {
+    case 0: return mv::make_memory_view(data());
+    case 1: return mv::memory_view(mv::mmap_memory_source(file_name));
+    case 2: return mv::memory_view(mv::file_memory_source(file_name));
+    default:
+        return mv::memory_view(mv::cached_memory_source(
+            mv::file_memory_source(file_name), 4096, file_size));
+    }
+}
+
+const char* source_name(int source)
+{
+    static const char* names[] = {"ptr", "mmap", "file", "cached"};
+    return names[source];
+}
+
+void slice(benchmark::State& state)
+{
+    auto view = make_view(state.range(0));
+    state.SetLabel(source_name(state.range(0)));
+    mv::trace::scope before;
+    std::ptrdiff_t offset = 0;
+    for (auto _ : state) {
+        auto slice = view(offset, offset + 64);
+        benchmark::DoNotOptimize(slice);
+        offset = (offset + 64) % (file_size - 64);
+    }
+    count_allocations(state, before);
+}
+BENCHMARK(slice)->DenseRange(0, 3)->ThreadRange(1, 4);
+
+void slice_basic_view(benchmark::State& state)
+{
+    mv::basic_memory_view view{mv::ptr_memory_source(data())};
+    mv::trace::scope before;
+    std::ptrdiff_t offset = 0;
+    for (auto _ : state) {
+        auto slice = view(offset, offset + 64);
+        benchmark::DoNotOptimize(slice);
+        offset = (offset + 64) % (file_size - 64);
+    }
+    count_allocations(state, before);
+}
+BENCHMARK(slice_basic_view)->ThreadRange(1, 4);
+
+/// Args: source, slice length, access pattern.
+void first_touch(benchmark::State& state)
+{
+    auto view = make_view(state.range(0));
+    auto length = static_cast<std::size_t>(state.range(1));
+    auto access = static_cast<pattern>(state.range(2));
+    auto positions = offsets(1 << 12, length, access);
+    state.SetLabel(std::string(source_name(state.range(0)))
+                   + (access == pattern::sequential ? "/sequential" : "/random"));
+    mv::trace::scope before;
+    std::size_t idx = 0;
+    for (auto _ : state) {
+        auto offset = positions[idx++ % positions.size()];
+        auto slice = view(offset, offset + length);
+        benchmark::DoNotOptimize(slice.as_ptr());
+    }
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(first_touch)
+    ->ArgsProduct({{0, 1, 2, 3}, {64, 4096, 1 << 16}, {0, 1}})
+    ->ThreadRange(1, 4);
+
+void first_touch_istream(benchmark::State& state)
+{
+    data();
+    std::ifstream is(file_name);
+    mv::memory_view view(mv::istream_memory_source(is, file_size));
+    auto length = static_cast<std::size_t>(state.range(0));
+    auto positions = offsets(1 << 12, length, static_cast<pattern>(state.range(1)));
+    mv::trace::scope before;
+    std::size_t idx = 0;
+    for (auto _ : state) {
+        auto offset = positions[idx++ % positions.size()];
+        auto slice = view(offset, offset + length);
+        benchmark::DoNotOptimize(slice.as_ptr());
+    }
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(first_touch_istream)->ArgsProduct({{64, 4096, 1 << 16}, {0, 1}});
+
+void repeated_access(benchmark::State& state)
+{
+    auto view = make_view(state.range(0))(0, 4096);
+    state.SetLabel(source_name(state.range(0)));
+    mv::trace::scope before;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(view.as<int>());
+    }
+    count_allocations(state, before);
+}
+BENCHMARK(repeated_access)->DenseRange(0, 3);
+
+void unpack(benchmark::State& state)
+{
+    using record = mv::packed_layout<std::int32_t, std::int16_t, std::int8_t, std::int64_t>;
+    auto view = make_view(state.range(0))(0, record::size);
+    view.materialize();
+    state.SetLabel(source_name(state.range(0)));
+    mv::trace::scope before;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            view.unpack<std::int32_t, std::int16_t, std::int8_t, std::int64_t>());
+    }
+    count_allocations(state, before);
+}
+BENCHMARK(unpack)->DenseRange(0, 3);
+
+void unpack_head(benchmark::State& state)
+{
+    auto view = make_view(state.range(0))(0, 1 << 16);
+    state.SetLabel(source_name(state.range(0)));
+    mv::trace::scope before;
+    std::int64_t sum = 0;
+    for (auto _ : state) {
+        auto tail = view;
+        while (tail.size() >= sizeof(std::int64_t)) {
+            auto [value, rest] = tail.unpack_head<std::int64_t>();
+            sum += value;
+            tail = rest;
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * (1 << 16));
+}
+BENCHMARK(unpack_head)->DenseRange(0, 1);
+
+void cursor(benchmark::State& state)
+{
+    auto view = make_view(state.range(0))(0, 1 << 16);
+    state.SetLabel(source_name(state.range(0)));
+    mv::trace::scope before;
+    std::int64_t sum = 0;
+    for (auto _ : state) {
+        mv::memory_cursor cursor(view, 4096);
+        while (!cursor.done()) {
+            sum += cursor.read<std::int64_t>();
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * (1 << 16));
+}
+BENCHMARK(cursor)->DenseRange(0, 3);
+
+void scan_span(benchmark::State& state)
+{
+    auto view = make_view(state.range(0));
+    state.SetLabel(source_name(state.range(0)));
+    for (auto _ : state) {
+        auto span = view.as_span<std::uint64_t>();
+        benchmark::DoNotOptimize(std::accumulate(span.begin(), span.end(), 0ul));
+    }
+    state.SetBytesProcessed(state.iterations() * file_size);
+}
+BENCHMARK(scan_span)->DenseRange(0, 1);
+
+/// Arg: number of threads.
+void parallel_scan(benchmark::State& state)
+{
+    std::vector<std::uint64_t> values(1 << 22, 3);
+    auto view = mv::make_memory_view(values);
+    mv::parallel_options options;
+    options.threads = static_cast<unsigned>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mv::parallel_reduce<std::uint64_t>(
+            view,
+            std::uint64_t{0},
+            [](mv::memory_view chunk) {
+                auto span = chunk.as_span<std::uint64_t>();
+                return std::accumulate(span.begin(), span.end(), std::uint64_t{0});
+            },
+            std::plus<>{},
+            options));
+    }
+    state.SetBytesProcessed(state.iterations() * view.size());
+}
+BENCHMARK(parallel_scan)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+/// Arg: 0 for `std::lower_bound`, 1 for `sorted_view`, 2 for `eytzinger_view`.
+void search_sorted(benchmark::State& state)
+{
+    std::vector<std::uint32_t> values(1 << 22);
+    for (std::size_t idx = 0; idx < values.size(); ++idx) {
+        values[idx] = static_cast<std::uint32_t>(3 * idx);
+    }
+    auto layout = mv::eytzinger_layout(gsl::span<const std::uint32_t>(values));
+    auto sorted = mv::make_memory_view(values).as_sorted<std::uint32_t>();
+    auto eytzinger = mv::make_memory_view(layout).as_eytzinger<std::uint32_t>();
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<std::uint32_t> dist(0, 3 * values.size());
+    std::vector<std::uint32_t> probes(1 << 12);
+    for (auto& probe : probes) { probe = dist(gen); }
+    for (auto _ : state) {
+        std::size_t sum = 0;
+        for (auto probe : probes) {
+            switch (state.range(0)) {
+            case 0:
+                sum += std::lower_bound(values.begin(), values.end(), probe) - values.begin();
+                break;
+            case 1: sum += sorted.lower_bound(probe); break;
+            default: sum += eytzinger.lower_bound(probe);
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * probes.size());
+}
+BENCHMARK(search_sorted)->DenseRange(0, 2);
+
+/// Arg: 0 for manual slicing, 1 for `indexed_view`, 2 for Elias-Fano offsets.
+void indexed_records(benchmark::State& state)
+{
+    std::vector<std::string> records;
+    std::mt19937 gen(17);
+    for (int idx = 0; idx < (1 << 16); ++idx) { records.emplace_back(gen() % 64, 'x'); }
+    auto data = mv::encode_indexed(records,
+                                   state.range(0) == 2 ? mv::offset_encoding::elias_fano
+                                                       : mv::offset_encoding::plain);
+    auto view = mv::make_memory_view(data);
+    auto indexed = view.as_indexed();
+    auto offsets = view(16, 16 + 8 * (records.size() + 1)).as_span<std::uint64_t>();
+    auto payload = view(16 + 8 * (records.size() + 1), mv::end);
+    std::uniform_int_distribution<std::size_t> dist(0, records.size() - 1);
+    std::vector<std::size_t> probes(1 << 12);
+    for (auto& probe : probes) { probe = dist(gen); }
+    for (auto _ : state) {
+        std::size_t sum = 0;
+        for (auto probe : probes) {
+            if (state.range(0) == 0) {
+                sum += payload(offsets[probe], offsets[probe + 1]).size();
+            } else {
+                sum += indexed[probe].size();
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * probes.size());
+}
+BENCHMARK(indexed_records)->DenseRange(0, 2);
+
+/// Arg: percentage of values that need more than one byte.
+void decode_varints(benchmark::State& state)
+{
+    std::vector<char> bytes;
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<int> percent(0, 99);
+    for (int idx = 0; idx < (1 << 16); ++idx) {
+        std::uint32_t value = percent(gen) < state.range(0) ? 1u << 20 : 100;
+        for (; value >= 0x80; value >>= 7) {
+            bytes.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        }
+        bytes.push_back(static_cast<char>(value));
+    }
+    auto sequence = mv::make_memory_view(bytes).as_varint_sequence<std::uint32_t>();
+    std::vector<std::uint32_t> values(1 << 16);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sequence.decode(values));
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(decode_varints)->Arg(0)->Arg(5)->Arg(50);
+
+void decode_bitpacked(benchmark::State& state)
+{
+    std::vector<char> bytes(((1 << 16) * 13 + 7) / 8, 0x5A);
+    auto sequence = mv::make_memory_view(bytes).as_bitpacked<13>();
+    std::vector<std::uint32_t> values(sequence.size());
+    for (auto _ : state) {
+        sequence.decode(0, values);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(decode_bitpacked);
+
+/// Arg: 0 for the native byte order, 1 for the opposite one.
+void byteswap_span(benchmark::State& state)
+{
+    std::vector<char> bytes((1 << 16) * sizeof(std::uint32_t), 0x5A);
+    auto view = mv::make_memory_view(bytes);
+    std::vector<std::uint32_t> values(1 << 16);
+    bool swap = (state.range(0) == 1) == (mv::endian::native == mv::endian::little);
+    for (auto _ : state) {
+        auto span = swap ? view.as_span_be<std::uint32_t>(values)
+                         : view.as_span_le<std::uint32_t>(values);
+        benchmark::DoNotOptimize(span.data());
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(byteswap_span)->Arg(0)->Arg(1);
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+    benchmark::RunSpecifiedBenchmarks();
+    std::remove(file_name);
+    return 0;
+}
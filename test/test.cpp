@@ -24,7 +24,16 @@
 /// \author Michal Siedlaczek
 /// \copyright MIT License
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
 
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <gmock/gmock.h>
@@ -32,6 +41,10 @@
 
 #include <memory_view.hpp>
 
+#ifdef MEMORY_VIEW_TRACING
+MEMORY_VIEW_TRACE_ALLOCATIONS()
+#endif
+
 namespace {
 
 using mv::memory_view;
@@ -176,6 +189,1946 @@ TEST(memory_view, create_from_file)
     ASSERT_THAT(mv.as_span<int>(), ::testing::ElementsAreArray(vec));
 }
 
+TEST(memory_view, create_from_mmap)
+{
+    std::vector<int> vec = {0, 1, 2, 3};
+    {
+        std::ofstream out("tmpfile");
+        out.write(reinterpret_cast<char*>(&vec[0]), vec.size() * sizeof(int));
+    }
+    mv::memory_view mv(mv::mmap_memory_source("tmpfile"));
+    ASSERT_EQ(mv.size(), 16);
+    ASSERT_THAT(mv.as_span<int>(), ::testing::ElementsAreArray(vec));
+    ASSERT_EQ(mv(8, 12).as<int>(), 2);
+}
+
+TEST(memory_view, mmap_outlives_source)
+{
+    std::vector<int> vec = {0, 1, 2, 3};
+    {
+        std::ofstream out("tmpfile");
+        out.write(reinterpret_cast<char*>(&vec[0]), vec.size() * sizeof(int));
+    }
+    mv::memory_view slice;
+    {
+        mv::memory_view mv(
+            mv::mmap_memory_source("tmpfile", mv::access_hint::sequential));
+        mv.advise(mv::access_hint::random);
+        mv.prefetch();
+        slice = mv(4, mv::end);
+        slice.as_ptr();
+    }
+    ASSERT_THAT(slice.as_span<int>(), ::testing::ElementsAre(1, 2, 3));
+}
+
+TEST(memory_view, mmap_missing_file)
+{
+    ASSERT_THROW(mv::mmap_memory_source("no/such/file"), std::system_error);
+}
+
+class counting_source {
+public:
+    counting_source(const std::vector<char>& data, int& count)
+        : source_(data), count_(count)
+    {}
+    const mv::slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        ++count_;
+        return source_.slice(begin, end);
+    }
+    std::size_t size() const { return source_.size(); }
+
+private:
+    mv::ptr_memory_source source_;
+    int& count_;
+};
+
+static_assert(!std::is_default_constructible_v<mv::cached_memory_source<ptr_memory_source>>);
+
+class cached_memory_source_suite : public ::testing::Test {
+protected:
+    std::vector<char> data = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int fetches = 0;
+    mv::memory_view mv = mv::memory_view(mv::cached_memory_source(
+        counting_source(data, fetches), 4, 8));
+};
+
+TEST_F(cached_memory_source_suite, within_block)
+{
+    ASSERT_THAT(mv(1, 3).as_span<char>(), ::testing::ElementsAre(1, 2));
+    ASSERT_THAT(mv(0, 4).as_span<char>(), ::testing::ElementsAre(0, 1, 2, 3));
+    ASSERT_EQ(fetches, 1);
+    ASSERT_EQ(mv(8, mv::end).as_span<char>().size(), 2);
+    ASSERT_EQ(fetches, 2);
+}
+
+TEST_F(cached_memory_source_suite, across_blocks)
+{
+    ASSERT_THAT(mv(3, 9).as_span<char>(),
+                ::testing::ElementsAre(3, 4, 5, 6, 7, 8));
+    ASSERT_EQ(fetches, 3);
+    ASSERT_THAT(mv(4, mv::end).as_span<char>(),
+                ::testing::ElementsAre(4, 5, 6, 7, 8, 9));
+    ASSERT_EQ(fetches, 3);
+}
+
+TEST_F(cached_memory_source_suite, evicts_least_recently_used)
+{
+    mv(0, 1).as_ptr();
+    mv(4, 5).as_ptr();
+    mv(8, 9).as_ptr();
+    ASSERT_EQ(fetches, 3);
+    mv(4, 5).as_ptr();
+    ASSERT_EQ(fetches, 3);
+    mv(0, 1).as_ptr();
+    ASSERT_EQ(fetches, 4);
+}
+
+TEST_F(cached_memory_source_suite, pinned_blocks_are_kept)
+{
+    auto pinned = mv(0, 2);
+    pinned.as_ptr();
+    mv(4, 5).as_ptr();
+    mv(8, 9).as_ptr();
+    ASSERT_EQ(fetches, 3);
+    mv(0, 1).as_ptr();
+    ASSERT_EQ(fetches, 3);
+    ASSERT_THAT(pinned.as_span<char>(), ::testing::ElementsAre(0, 1));
+}
+
+TEST_F(cached_memory_source_suite, zero_block_size)
+{
+    ASSERT_THROW(mv::cached_memory_source(counting_source(data, fetches), 0, 8),
+                 std::invalid_argument);
+}
+
+TEST(cached_memory_source, prefetch_fills_cache)
+{
+    std::vector<char> data = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int fetches = 0;
+    auto cache = std::make_shared<mv::block_cache>(16);
+    {
+        mv::memory_view view(
+            mv::cached_memory_source(counting_source(data, fetches), 4, cache));
+        view(2, 6).prefetch();
+        for (int attempt = 0; attempt < 1000 && cache->size() < 8; ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_EQ(cache->size(), 8);
+        ASSERT_EQ(fetches, 2);
+        ASSERT_THAT(view(3, 5).as_span<char>(), ::testing::ElementsAre(3, 4));
+        ASSERT_EQ(fetches, 2);
+    }
+    // Wait for the prefetching thread to release the source.
+    for (int attempt = 0; attempt < 1000 && cache->size() > 0; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(cache->size(), 0);
+}
+
+class slow_source {
+public:
+    slow_source(const std::vector<char>& data, std::atomic<int>& count)
+        : source_(data), count_(count)
+    {}
+    const mv::slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        ++count_;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return source_.slice(begin, end);
+    }
+    std::size_t size() const { return source_.size(); }
+
+private:
+    mv::ptr_memory_source source_;
+    std::atomic<int>& count_;
+};
+
+TEST(memory_view, synchronized_fetches_once)
+{
+    std::vector<char> data = {0, 1, 2, 3};
+    std::atomic<int> fetches = 0;
+    const auto view = mv::memory_view(slow_source(data, fetches)).synchronized();
+    ASSERT_TRUE(view.is_synchronized());
+    std::vector<std::thread> threads;
+    for (int idx = 0; idx < 4; ++idx) {
+        threads.emplace_back([&view]() { ASSERT_EQ(view(1, 2).as<char>(), 1); });
+        threads.emplace_back([&view]() { ASSERT_EQ(view.as<char>(), 0); });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    ASSERT_EQ(fetches, 5);
+}
+
+TEST(memory_view, synchronized_slices)
+{
+    std::vector<char> data = {0, 1, 2, 3};
+    std::atomic<int> fetches = 0;
+    auto view = mv::memory_view(slow_source(data, fetches)).synchronized();
+    auto before = view(1, 3);
+    ASSERT_TRUE(before.is_synchronized());
+    view.as_ptr();
+    auto after = view(2, mv::end);
+    ASSERT_TRUE(after.is_synchronized());
+    ASSERT_THAT(after.as_span<char>(), ::testing::ElementsAre(2, 3));
+    ASSERT_EQ(fetches, 1);
+    ASSERT_THAT(before.as_span<char>(), ::testing::ElementsAre(1, 2));
+    ASSERT_EQ(fetches, 2);
+}
+
+static_assert(mv::detail::is_thread_safe<slow_source>::value);
+static_assert(!mv::detail::is_thread_safe<mv::istream_memory_source>::value);
+
+TEST(cached_memory_source, concurrent_fetches)
+{
+    std::vector<char> data(64, 1);
+    std::atomic<int> fetches = 0;
+    auto view = mv::memory_view(mv::cached_memory_source(slow_source(data, fetches), 8, 64));
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int idx = 0; idx < 16; ++idx) {
+        threads.emplace_back([&view, idx]() {
+            auto begin = idx % 8 * 8;
+            ASSERT_EQ(view(begin, begin + 8).as<char>(), 1);
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    ASSERT_EQ(fetches, 8);
+    ASSERT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(60));
+}
+
+TEST(memory_view, grouped_slices_fetch_once)
+{
+    std::vector<char> data(24);
+    std::iota(data.begin(), data.end(), 0);
+    int fetches = 0;
+    auto record = mv::memory_view(counting_source(data, fetches))(4, 24).grouped();
+    std::vector<mv::memory_view> fields;
+    for (std::ptrdiff_t pos = 0; pos < 20; pos += 2) {
+        fields.push_back(record(pos, pos + 2));
+    }
+    auto nested = fields[3](1, mv::end);
+    ASSERT_EQ(fetches, 0);
+    for (std::size_t idx = 0; idx < fields.size(); ++idx) {
+        ASSERT_EQ(fields[idx].as<char>(), static_cast<char>(4 + 2 * idx));
+    }
+    ASSERT_EQ(nested.as<char>(), 11);
+    ASSERT_EQ(record(mv::begin, 1).as<char>(), 4);
+    ASSERT_EQ(fetches, 1);
+}
+
+TEST(memory_view, materialize)
+{
+    std::vector<char> data = {0, 1, 2, 3};
+    int fetches = 0;
+    auto view = mv::memory_view(counting_source(data, fetches));
+    view(0, 2).as_ptr();
+    view(2, 4).as_ptr();
+    ASSERT_EQ(fetches, 2);
+    view.materialize();
+    ASSERT_EQ(fetches, 3);
+    ASSERT_EQ(view(mv::begin, 2).as<char>(), 0);
+    ASSERT_EQ(view(1, mv::end).as<char>(), 1);
+    ASSERT_EQ(view(3, 4).as<char>(), 3);
+    ASSERT_EQ(fetches, 3);
+}
+
+class prefetching_source {
+public:
+    prefetching_source(std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>>& log)
+        : log_(log)
+    {}
+    const mv::slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return {data_.data(), nullptr};
+    }
+    std::size_t size() const { return data_.size(); }
+    void prefetch(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        log_.emplace_back(begin, end);
+    }
+
+private:
+    std::vector<char> data_ = std::vector<char>(16);
+    std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>>& log_;
+};
+
+TEST(memory_view, prefetch)
+{
+    std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>> log;
+    mv::memory_view view(prefetching_source{log});
+    std::vector<mv::memory_view> views = {view(0, 4), view(8, mv::end)};
+    view(2, 6).prefetch();
+    mv::prefetch(views);
+    ASSERT_THAT(log, ::testing::ElementsAre(
+        std::make_pair(2, 6), std::make_pair(0, 4), std::make_pair(8, 16)));
+    views[0].as_ptr();
+    views[0].prefetch();
+    ASSERT_EQ(log.size(), 3);
+}
+
+TEST(memory_view, prefetch_without_support)
+{
+    std::vector<char> data = {0, 1, 2, 3};
+    mv::memory_view(mv::ptr_memory_source(data)).prefetch();
+    std::istringstream is(std::string(data.begin(), data.end()));
+    mv::memory_view(mv::istream_memory_source(is, 4)).prefetch();
+}
+
+class file_memory_source_suite : public ::testing::TestWithParam<mv::io_mode> {
+protected:
+    void SetUp() override
+    {
+        vec.resize(1024);
+        std::iota(vec.begin(), vec.end(), 0);
+        std::ofstream out("tmpfile");
+        out.write(reinterpret_cast<char*>(&vec[0]), vec.size() * sizeof(int));
+    }
+    std::vector<int> vec;
+};
+
+TEST_P(file_memory_source_suite, slice)
+{
+    mv::memory_view mv(mv::file_memory_source("tmpfile", GetParam()));
+    ASSERT_EQ(mv.size(), 4096);
+    ASSERT_THAT(mv.as_span<int>(), ::testing::ElementsAreArray(vec));
+    ASSERT_EQ(mv(400, 404).as<int>(), 100);
+}
+
+TEST_P(file_memory_source_suite, slice_many)
+{
+    mv::file_memory_source source("tmpfile", GetParam(), 4);
+    std::vector<mv::byte_range> ranges;
+    for (int idx = 0; idx < 10; ++idx) {
+        ranges.push_back({idx * 400, idx * 400 + 8});
+    }
+    ranges.push_back({16, 16});
+    std::vector<mv::slice_data> slices(ranges.size());
+    source.slice_many(ranges, slices);
+    for (int idx = 0; idx < 10; ++idx) {
+        auto values = reinterpret_cast<const int*>(slices[idx].ptr);
+        ASSERT_EQ(values[0], idx * 100);
+        ASSERT_EQ(values[1], idx * 100 + 1);
+    }
+    ASSERT_EQ(slices.back().ptr, nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(io_modes,
+                         file_memory_source_suite,
+                         ::testing::Values(mv::io_mode::pread,
+                                           mv::io_mode::io_uring));
+
+TEST(memory_view, file_missing)
+{
+    ASSERT_THROW(mv::file_memory_source("no/such/file"), std::system_error);
+}
+
+TEST(memory_view, default_file_source)
+{
+    mv::file_memory_source source;
+    ASSERT_EQ(source.size(), 0);
+    ASSERT_EQ(source.slice(0, 0).ptr, nullptr);
+    ASSERT_EQ(source.slice(0, 4).ptr, nullptr);
+    std::array<mv::byte_range, 2> ranges = {{{0, 0}, {0, 4}}};
+    std::array<mv::slice_data, 2> out = {};
+    source.slice_many(ranges, out);
+    ASSERT_EQ(out[0].ptr, nullptr);
+    ASSERT_EQ(out[1].ptr, nullptr);
+    source.advise(0, 0, mv::access_hint::random);
+    source.prefetch(0, 0);
+    ASSERT_FALSE(source.uses_io_uring());
+    memory_view view(source);
+    ASSERT_TRUE(view.empty());
+    view.advise(mv::access_hint::sequential);
+    view.prefetch();
+    std::vector<memory_view> views = {view, view(0, 0)};
+    mv::fetch(gsl::span<memory_view>(views));
+    ASSERT_EQ(views[0].as_ptr(), nullptr);
+}
+
+class batching_source {
+public:
+    batching_source(const std::vector<char>& data,
+                    std::vector<std::vector<mv::byte_range>>& batches)
+        : source_(data), batches_(batches)
+    {}
+    const mv::slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        return source_.slice(begin, end);
+    }
+    void slice_many(gsl::span<const mv::byte_range> ranges,
+                    gsl::span<mv::slice_data> out) const
+    {
+        mv::detail::coalesced_slice_many(
+            ranges, out, 0, [this](auto merged, auto fetched) {
+                batches_.emplace_back(merged.begin(), merged.end());
+                for (std::ptrdiff_t idx = 0; idx < static_cast<std::ptrdiff_t>(merged.size()); ++idx) {
+                    fetched[idx] = slice(merged[idx].begin, merged[idx].end);
+                }
+            });
+    }
+    std::size_t size() const { return source_.size(); }
+
+private:
+    mv::ptr_memory_source source_;
+    std::vector<std::vector<mv::byte_range>>& batches_;
+};
+
+TEST(memory_view, fetch_coalesces_ranges)
+{
+    std::vector<char> data = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<std::vector<mv::byte_range>> batches;
+    mv::memory_view view(batching_source(data, batches));
+    std::vector<char> other_data = {10, 11};
+    int other_fetches = 0;
+    mv::memory_view other(counting_source(other_data, other_fetches));
+    std::vector<mv::memory_view> views = {
+        view(6, 8), other(0, 1), view(0, 3), view(2, 5), other(1, 2), view(9, 9)};
+    mv::fetch(views);
+    ASSERT_EQ(batches.size(), 1);
+    ASSERT_EQ(batches[0].size(), 2);
+    ASSERT_EQ(batches[0][0].begin, 0);
+    ASSERT_EQ(batches[0][0].end, 5);
+    ASSERT_EQ(batches[0][1].begin, 6);
+    ASSERT_EQ(batches[0][1].end, 8);
+    ASSERT_EQ(other_fetches, 2);
+    ASSERT_THAT(views[0].as_span<char>(), ::testing::ElementsAre(6, 7));
+    ASSERT_THAT(views[1].as_span<char>(), ::testing::ElementsAre(10));
+    ASSERT_THAT(views[2].as_span<char>(), ::testing::ElementsAre(0, 1, 2));
+    ASSERT_THAT(views[3].as_span<char>(), ::testing::ElementsAre(2, 3, 4));
+    ASSERT_THAT(views[4].as_span<char>(), ::testing::ElementsAre(11));
+    ASSERT_EQ(batches.size(), 1);
+    ASSERT_EQ(other_fetches, 2);
+}
+
+TEST(memory_view, fetch_from_stream)
+{
+    std::string data = "abcdefgh";
+    std::istringstream is(data);
+    mv::memory_view view(mv::istream_memory_source(is, data.size()));
+    std::vector<mv::memory_view> views = {view(4, 8), view(0, 2), view(1, 5)};
+    mv::fetch(views);
+    ASSERT_EQ(views[1].as_ptr() + 1, views[2].as_ptr());
+    ASSERT_EQ(std::string(views[0].as_ptr(), 4), "efgh");
+    ASSERT_EQ(std::string(views[2].as_ptr(), 4), "bcde");
+}
+
+TEST(buffer_pool, reuses_buffers_of_same_class)
+{
+    mv::buffer_pool pool;
+    void* first = pool.allocate(100);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(first) % mv::buffer_pool::alignment, 0);
+    pool.deallocate(first, 100);
+    void* second = pool.allocate(120);
+    ASSERT_EQ(first, second);
+    void* third = pool.allocate(120);
+    ASSERT_NE(second, third);
+    pool.deallocate(second, 120);
+    pool.deallocate(third, 120);
+    void* large = pool.allocate(std::size_t(1) << 26);
+    pool.deallocate(large, std::size_t(1) << 26);
+}
+
+TEST(buffer_pool, handler_returns_buffer)
+{
+    mv::buffer_pool pool;
+    const char* data = nullptr;
+    {
+        auto handler = mv::pooled_handler::make(1000, pool);
+        ASSERT_EQ(handler->size(), 1000);
+        data = handler->data();
+    }
+    auto handler = mv::pooled_handler::make(1000, pool);
+    ASSERT_EQ(handler->data(), data);
+}
+
+class borrowed_source {
+public:
+    static constexpr bool borrowed = true;
+    borrowed_source(const std::vector<char>& data, int& count)
+        : data_(data), count_(count)
+    {}
+    const mv::slice_data slice(std::ptrdiff_t begin, std::ptrdiff_t end) const
+    {
+        ++count_;
+        return {std::next(data_.data(), begin), nullptr};
+    }
+    std::size_t size() const { return data_.size(); }
+
+private:
+    const std::vector<char>& data_;
+    int& count_;
+};
+
+TEST(memory_view, borrowed_source_resolved_once)
+{
+    std::vector<char> data = {0, 1, 2, 3};
+    int fetches = 0;
+    mv::memory_view view(borrowed_source(data, fetches));
+    ASSERT_EQ(fetches, 1);
+    auto slice = view(1, 3);
+    ASSERT_EQ(slice.as_ptr(), &data[1]);
+    ASSERT_THAT(slice(1, mv::end).as_span<char>(), ::testing::ElementsAre(2));
+    ASSERT_THAT(view.unpack_head<char>(), ::testing::FieldsAre(0, ::testing::_));
+    view.prefetch();
+    view.advise(mv::access_hint::random);
+    ASSERT_EQ(fetches, 1);
+}
+
+TEST(memory_view, default_constructed_is_empty)
+{
+    mv::memory_view view;
+    ASSERT_TRUE(view.empty());
+    ASSERT_EQ(view.as_ptr(), nullptr);
+    ASSERT_TRUE(mv::memory_view(mv::ptr_memory_source()).empty());
+    ASSERT_TRUE(mv::memory_view(mv::mmap_memory_source()).empty());
+    ASSERT_TRUE(mv::mutable_memory_view(mv::mutable_mmap_source()).empty());
+    ASSERT_TRUE(mv::memory_view(mv::file_memory_source()).empty());
+    ASSERT_TRUE(mv::memory_view(mv::chained_memory_source()).empty());
+}
+
+TEST(basic_memory_view, ptr_source)
+{
+    std::array<char, 4> arr = {1, 2, 3, 4};
+    mv::basic_memory_view view(ptr_memory_source(arr.data(), arr.size()));
+    ASSERT_EQ(view.size(), 4);
+    ASSERT_EQ(view.as<int>(), 67305985);
+    ASSERT_EQ(view(1, 3).as_ptr(), &arr[1]);
+    ASSERT_EQ(view(mv::begin, 3).size(), 3);
+    auto [n, tail] = view.unpack_head<std::int8_t>();
+    static_assert(std::is_same_v<decltype(tail), decltype(view)>);
+    ASSERT_EQ(n, 1);
+    ASSERT_THAT(tail.as_span<char>(), ::testing::ElementsAre(2, 3, 4));
+}
+
+TEST(basic_memory_view, lazy_source_to_memory_view)
+{
+    std::vector<char> data = {0, 1, 2, 3, 4, 5};
+    int fetches = 0;
+    mv::basic_memory_view view(counting_source(data, fetches));
+    auto slice = view(2, mv::end);
+    ASSERT_EQ(fetches, 0);
+    ASSERT_THAT(slice.as_span<char>(), ::testing::ElementsAre(2, 3, 4, 5));
+    ASSERT_EQ(fetches, 1);
+    mv::memory_view erased = slice(1, 3);
+    ASSERT_EQ(erased.size(), 2);
+    ASSERT_EQ(erased.as<char>(), 3);
+    ASSERT_EQ(fetches, 1);
+    mv::memory_view unfetched = view(0, 2);
+    ASSERT_THAT(unfetched.as_span<char>(), ::testing::ElementsAre(0, 1));
+    ASSERT_EQ(fetches, 2);
+}
+
+/// Run-length encoding: pairs of (count, byte).
+std::vector<char> rle_compress(const std::vector<char>& data)
+{
+    std::vector<char> out;
+    for (std::size_t pos = 0; pos < data.size();) {
+        std::size_t run = 1;
+        while (pos + run < data.size() && data[pos + run] == data[pos] && run < 127) {
+            ++run;
+        }
+        out.push_back(static_cast<char>(run));
+        out.push_back(data[pos]);
+        pos += run;
+    }
+    return out;
+}
+
+struct rle_codec {
+    std::size_t operator()(gsl::span<const char> in, gsl::span<char> out) const
+    {
+        ++*calls;
+        std::size_t size = 0;
+        for (std::ptrdiff_t pos = 0; pos + 1 < static_cast<std::ptrdiff_t>(in.size()); pos += 2) {
+            for (int idx = 0; idx < in[pos]; ++idx) { out[size++] = in[pos + 1]; }
+        }
+        return size;
+    }
+    int* calls;
+};
+
+static_assert(
+    !std::is_default_constructible_v<mv::compressed_memory_source<ptr_memory_source, rle_codec>>);
+
+class compressed_memory_source_suite : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        for (int block = 0; block < 4; ++block) {
+            std::vector<char> decompressed(block == 3 ? 6 : 10, char('a' + block));
+            decompressed.back() = 'z';
+            auto bytes = rle_compress(decompressed);
+            blocks.push_back({static_cast<std::ptrdiff_t>(compressed.size()),
+                              bytes.size(),
+                              decompressed.size()});
+            compressed.insert(compressed.end(), bytes.begin(), bytes.end());
+            data.insert(data.end(), decompressed.begin(), decompressed.end());
+        }
+    }
+
+    mv::memory_view make_view(std::size_t capacity)
+    {
+        return mv::memory_view(mv::compressed_memory_source(
+            mv::ptr_memory_source(compressed), blocks, rle_codec{&calls}, capacity));
+    }
+
+    std::vector<char> compressed;
+    std::vector<char> data;
+    std::vector<mv::compressed_block> blocks;
+    int calls = 0;
+};
+
+TEST_F(compressed_memory_source_suite, decompresses_touched_blocks)
+{
+    auto view = make_view(1024);
+    ASSERT_EQ(view.size(), data.size());
+    ASSERT_EQ(std::string(view(12, 15).as_ptr(), 3), "bbb");
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(std::string(view(8, 22).as_ptr(), 14), "azbbbbbbbbbzcc");
+    ASSERT_EQ(calls, 3);
+    ASSERT_THAT(view.as_span<char>(), ::testing::ElementsAreArray(data));
+    ASSERT_EQ(calls, 4);
+}
+
+TEST_F(compressed_memory_source_suite, evicts_decompressed_blocks)
+{
+    auto view = make_view(10);
+    view(0, 1).as_ptr();
+    view(10, 11).as_ptr();
+    ASSERT_EQ(calls, 2);
+    ASSERT_EQ(view(0, 1).as<char>(), 'a');
+    ASSERT_EQ(calls, 3);
+}
+
+TEST_F(compressed_memory_source_suite, invalid_block)
+{
+    blocks[1].size = 11;
+    auto view = make_view(1024);
+    ASSERT_THROW(view(12, 13).as_ptr(), std::runtime_error);
+}
+
+class chained_memory_source_suite : public ::testing::Test {
+protected:
+    std::vector<char> first = {0, 1, 2};
+    std::vector<char> second = {3, 4};
+    std::vector<char> third = {5, 6, 7, 8};
+    mv::memory_view view = mv::memory_view(mv::chained_memory_source(
+        {mv::make_memory_view(first),
+         mv::memory_view(),
+         mv::make_memory_view(second),
+         mv::make_memory_view(third)}));
+};
+
+TEST_F(chained_memory_source_suite, zero_copy_within_chunk)
+{
+    ASSERT_EQ(view.size(), 9);
+    ASSERT_EQ(view(1, 3).as_ptr(), &first[1]);
+    ASSERT_EQ(view(3, 5).as_ptr(), &second[0]);
+    ASSERT_EQ(view(6, mv::end).as_ptr(), &third[1]);
+}
+
+TEST_F(chained_memory_source_suite, copies_across_chunks)
+{
+    ASSERT_THAT(view(2, 6).as_span<char>(), ::testing::ElementsAre(2, 3, 4, 5));
+    ASSERT_THAT(view.as_span<char>(),
+                ::testing::ElementsAre(0, 1, 2, 3, 4, 5, 6, 7, 8));
+}
+
+TEST_F(chained_memory_source_suite, segments)
+{
+    auto parts = view(1, 7).segments();
+    ASSERT_EQ(parts.size(), 3);
+    ASSERT_EQ(parts[0].as_ptr(), &first[1]);
+    ASSERT_EQ(parts[0].size(), 2);
+    ASSERT_EQ(parts[1].as_ptr(), &second[0]);
+    ASSERT_EQ(parts[1].size(), 2);
+    ASSERT_EQ(parts[2].as_ptr(), &third[0]);
+    ASSERT_EQ(parts[2].size(), 2);
+    auto single = mv::make_memory_view(first).segments();
+    ASSERT_EQ(single.size(), 1);
+    ASSERT_EQ(single[0].as_ptr(), &first[0]);
+}
+
+TEST_F(chained_memory_source_suite, keeps_lazy_chunks_alive)
+{
+    std::string data = "abcdef";
+    std::istringstream is(data);
+    mv::memory_view chained(mv::chained_memory_source(
+        {view, mv::memory_view(mv::istream_memory_source(is, data.size()))}));
+    auto slice = chained(10, 13);
+    ASSERT_EQ(std::string(slice.as_ptr(), 3), "bcd");
+    ASSERT_EQ(std::string(chained(7, 11).as_ptr(), 4), "\x07\x08" "ab");
+}
+
+TEST(chained_memory_source, default_is_empty)
+{
+    mv::chained_memory_source source;
+    ASSERT_EQ(source.size(), 0);
+    ASSERT_EQ(source.slice(0, 0).ptr, nullptr);
+    ASSERT_TRUE(source.segments(0, 0).empty());
+    memory_view view(source);
+    ASSERT_TRUE(view.empty());
+    ASSERT_EQ(view.as_ptr(), nullptr);
+    ASSERT_EQ(view.segments().size(), 1);
+}
+
+class memory_cursor_suite : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        for (std::int32_t value = 0; value < 16; ++value) {
+            auto bytes = reinterpret_cast<const char*>(&value);
+            data.insert(data.end(), bytes, bytes + sizeof(value));
+        }
+    }
+    std::vector<char> data;
+    int fetches = 0;
+};
+
+TEST_F(memory_cursor_suite, reads_through_windows)
+{
+    mv::memory_cursor cursor(mv::memory_view(counting_source(data, fetches)), 16);
+    for (std::int32_t value = 0; value < 16; ++value) {
+        ASSERT_EQ(cursor.read<std::int32_t>(), value);
+    }
+    ASSERT_TRUE(cursor.done());
+    ASSERT_EQ(fetches, 4);
+    ASSERT_THROW(cursor.read<char>(), std::out_of_range);
+}
+
+TEST_F(memory_cursor_suite, views_and_records)
+{
+    mv::memory_cursor cursor(mv::memory_view(counting_source(data, fetches)), 16);
+    cursor.skip(2);
+    auto small = cursor.read_view(6);
+    ASSERT_EQ(fetches, 1);
+    ASSERT_THAT(small.as_span<char>(), ::testing::ElementsAre(0, 0, 1, 0, 0, 0));
+    ASSERT_EQ(fetches, 1);
+    auto large = cursor.read_view(24);
+    ASSERT_EQ(fetches, 1);
+    ASSERT_EQ(large.as<std::int32_t>(), 2);
+    ASSERT_EQ(fetches, 2);
+    ASSERT_EQ(cursor.position(), 32);
+    auto record = cursor.read_record<std::int32_t>();
+    ASSERT_EQ(record.size(), 8);
+    ASSERT_EQ(record.as<std::int32_t>(), 9);
+    ASSERT_EQ(cursor.remaining(), 20);
+    ASSERT_EQ(cursor.rest().as<std::int32_t>(), 11);
+}
+
+TEST_F(memory_cursor_suite, static_memory)
+{
+    auto view = mv::make_memory_view(data);
+    mv::memory_cursor cursor(view, 4);
+    cursor.skip(4);
+    ASSERT_EQ(cursor.read_view(40).as_ptr(), &data[4]);
+    ASSERT_EQ(cursor.read<std::int32_t>(), 11);
+}
+
+template<typename T>
+std::vector<char> encode_varints(const std::vector<T>& values)
+{
+    std::vector<char> bytes;
+    for (T value : values) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<char>(value));
+    }
+    return bytes;
+}
+
+template<unsigned Bits, typename T>
+std::vector<char> pack_bits(const std::vector<T>& values)
+{
+    std::vector<char> bytes((values.size() * Bits + 7) / 8);
+    for (std::size_t idx = 0; idx < values.size(); ++idx) {
+        for (unsigned bit = 0; bit < Bits; ++bit) {
+            if ((values[idx] >> bit) & 1) {
+                auto pos = idx * Bits + bit;
+                bytes[pos / 8] |= static_cast<char>(1 << (pos % 8));
+            }
+        }
+    }
+    return bytes;
+}
+
+TEST(varint_sequence, decodes_mixed_lengths)
+{
+    std::vector<std::uint32_t> values;
+    for (std::uint32_t idx = 0; idx < 100; ++idx) {
+        values.push_back(idx % 7 == 0 ? idx * 100003u : idx);
+    }
+    values.push_back(std::numeric_limits<std::uint32_t>::max());
+    auto bytes = encode_varints(values);
+    auto sequence = mv::make_memory_view(bytes).as_varint_sequence<std::uint32_t>();
+    ASSERT_EQ(sequence.size(), values.size());
+    ASSERT_THAT(sequence.decode(), ::testing::ElementsAreArray(values));
+}
+
+TEST(varint_sequence, decodes_in_blocks)
+{
+    std::vector<std::uint64_t> values(50, 3);
+    values[20] = std::uint64_t(1) << 60;
+    values[45] = 300;
+    auto bytes = encode_varints(values);
+    auto decoder = mv::make_memory_view(bytes).as_varint_sequence<std::uint64_t>().decoder();
+    std::vector<std::uint64_t> decoded;
+    std::array<std::uint64_t, 16> block{};
+    while (!decoder.done()) {
+        auto count = decoder.next(block);
+        decoded.insert(decoded.end(), block.begin(), block.begin() + count);
+    }
+    ASSERT_THAT(decoded, ::testing::ElementsAreArray(values));
+}
+
+template<typename T>
+void check_random_varints(unsigned max_bytes)
+{
+    std::mt19937_64 gen(17);
+    std::vector<T> values(2000);
+    for (auto& value : values) {
+        auto bytes = std::uniform_int_distribution<unsigned>(1, max_bytes)(gen);
+        auto bits = std::min<unsigned>(bytes * 7, sizeof(T) * 8);
+        value = static_cast<T>(gen() >> (64 - bits));
+    }
+    auto bytes = encode_varints(values);
+    auto sequence = mv::make_memory_view(bytes).template as_varint_sequence<T>();
+    ASSERT_THAT(sequence.decode(), ::testing::ElementsAreArray(values));
+    std::vector<T> decoded;
+    std::vector<T> block(37);
+    auto decoder = sequence.decoder();
+    while (!decoder.done()) {
+        auto count = decoder.next(block);
+        decoded.insert(decoded.end(), block.begin(), block.begin() + count);
+    }
+    ASSERT_THAT(decoded, ::testing::ElementsAreArray(values));
+}
+
+TEST(varint_sequence, decodes_random_lengths)
+{
+    check_random_varints<std::uint32_t>(2);
+    check_random_varints<std::uint32_t>(3);
+    check_random_varints<std::uint32_t>(5);
+    check_random_varints<std::uint64_t>(3);
+    check_random_varints<std::uint64_t>(10);
+    check_random_varints<std::uint16_t>(3);
+}
+
+TEST(varint_sequence, truncated)
+{
+    std::vector<char> bytes = {1, char(0x80)};
+    auto sequence = mv::make_memory_view(bytes).as_varint_sequence<std::uint32_t>();
+    ASSERT_THROW(sequence.decode(), std::runtime_error);
+}
+
+template<unsigned Bits, typename T>
+void check_bitpacked()
+{
+    std::vector<T> values;
+    for (std::uint64_t idx = 0; idx < 77; ++idx) {
+        auto value = idx * 0x9E3779B97F4A7C15ull;
+        values.push_back(static_cast<T>(Bits == 64 ? value : value & ((1ull << Bits) - 1)));
+    }
+    auto bytes = pack_bits<Bits>(values);
+    auto sequence =
+        mv::make_memory_view(bytes).template as_bitpacked<Bits, T>(values.size());
+    ASSERT_EQ(sequence.size(), values.size());
+    for (std::size_t idx = 0; idx < values.size(); ++idx) {
+        ASSERT_EQ(sequence[idx], values[idx]);
+    }
+    ASSERT_THAT(sequence.decode(), ::testing::ElementsAreArray(values));
+    std::vector<T> tail(10);
+    sequence.decode(67, tail);
+    ASSERT_THAT(tail, ::testing::ElementsAreArray(values.begin() + 67, values.end()));
+}
+
+TEST(bitpacked_sequence, random_access_and_decode)
+{
+    check_bitpacked<1, std::uint32_t>();
+    check_bitpacked<3, std::uint32_t>();
+    check_bitpacked<13, std::uint32_t>();
+    check_bitpacked<32, std::uint32_t>();
+    check_bitpacked<59, std::uint64_t>();
+    check_bitpacked<64, std::uint64_t>();
+    std::vector<char> bytes(3);
+    ASSERT_EQ(mv::make_memory_view(bytes).as_bitpacked<5>().size(), 4);
+    ASSERT_THROW(mv::make_memory_view(bytes).as_bitpacked<5>(5), std::out_of_range);
+}
+
+class aligned_counting_source : public counting_source {
+public:
+    using counting_source::counting_source;
+    std::size_t alignment() const { return 8; }
+};
+
+std::uintptr_t address(const char* ptr) { return reinterpret_cast<std::uintptr_t>(ptr); }
+
+TEST(alignment, misaligned_access)
+{
+    std::vector<std::int32_t> values = {1, 2, 3, 4};
+    std::vector<char> bytes(1 + values.size() * sizeof(std::int32_t));
+    std::memcpy(&bytes[1], values.data(), values.size() * sizeof(std::int32_t));
+    auto view = mv::make_memory_view(bytes)(1, mv::end);
+    ASSERT_FALSE(view.is_aligned<std::int32_t>());
+    ASSERT_EQ(view.as<std::int32_t>(), 1);
+    ASSERT_THAT(view.unpack<std::int32_t>(), ::testing::FieldsAre(1));
+    ASSERT_THAT(view.as_sorted<std::int32_t>().values(), ::testing::ElementsAreArray(values));
+    ASSERT_EQ(view.as_sorted<std::int32_t>().lower_bound(3), 2);
+    ASSERT_EQ(view.as_eytzinger<std::int32_t>().size(), 4);
+    ASSERT_THAT(view.as_unaligned_span<std::int32_t>(),
+                ::testing::ElementsAreArray(values));
+    auto span = view.as_unaligned_span<std::int32_t>();
+    ASSERT_EQ(std::accumulate(span.begin(), span.end(), 0), 10);
+    ASSERT_EQ(span.end() - span.begin(), 4);
+    ASSERT_EQ(span[3], 4);
+}
+
+TEST(alignment, with_span)
+{
+    std::vector<std::int32_t> values = {1, 2, 3, 4};
+    auto view = mv::make_memory_view(values);
+    auto sum = [](auto span) { return std::accumulate(span.begin(), span.end(), 0); };
+    auto is_span = [](auto span) {
+        return std::is_same<decltype(span), gsl::span<const std::int32_t>>::value;
+    };
+    ASSERT_TRUE(view.with_span<std::int32_t>(is_span));
+    ASSERT_EQ(view.with_span<std::int32_t>(sum), 10);
+    ASSERT_FALSE(view(1, 13).with_span<std::int32_t>(is_span));
+    ASSERT_EQ(view(1, 13).with_span<std::int32_t>(sum), (2 + 3 + 4) << 24);
+}
+
+TEST(alignment, guaranteed_by_source)
+{
+    std::vector<char> data(64);
+    int fetches = 0;
+    auto view = mv::memory_view(aligned_counting_source(data, fetches));
+    ASSERT_TRUE(view(8, 16).is_aligned<std::int64_t>());
+    ASSERT_FALSE(view(4, 16).is_aligned<std::int64_t>());
+    ASSERT_TRUE(view(4, 16).is_aligned<std::int32_t>());
+    ASSERT_EQ(fetches, 0);
+    // Without a sufficient guarantee, the data is fetched and checked.
+    ASSERT_TRUE(view(16, 48).is_aligned<std::max_align_t>());
+    ASSERT_EQ(fetches, 1);
+}
+
+TEST(alignment, pooled_buffers)
+{
+    std::string content(256, 'x');
+    std::istringstream stream(content);
+    auto view = mv::memory_view(mv::istream_memory_source(stream, content.size()));
+    auto alignment = mv::buffer_pool::alignment;
+    for (std::ptrdiff_t begin : {0, 1, 7, 8, 63, 65, 100}) {
+        ASSERT_EQ(address(view(begin, begin + 20).as_ptr()) % alignment,
+                  begin % alignment);
+    }
+    auto cached = mv::memory_view(mv::cached_memory_source(
+        mv::istream_memory_source(stream, content.size()), 16, 256));
+    // Both within a block and across blocks.
+    ASSERT_TRUE(cached(8, 16).is_aligned<std::int64_t>());
+    ASSERT_EQ(address(cached(8, 16).as_ptr()) % 8, 0);
+    ASSERT_EQ(address(cached(8, 40).as_ptr()) % 8, 0);
+    ASSERT_EQ(address(cached(12, 40).as_ptr()) % 8, 4);
+}
+
+using record_layout = mv::layout<mv::field<std::uint32_t, 0, mv::endian::big>,
+                                 mv::field<std::uint8_t, 4>,
+                                 mv::field<std::int16_t, 6, mv::endian::little>>;
+
+static_assert(record_layout::size == 8);
+static_assert(mv::packed_layout<std::int8_t, std::int32_t, std::int16_t>::size == 7);
+static_assert(std::is_same<mv::packed_layout<std::int8_t, std::int32_t>,
+                           mv::layout<mv::field<std::int8_t, 0>,
+                                      mv::field<std::int32_t, 1>>>::value);
+
+struct record {
+    std::uint32_t id;
+    std::uint8_t kind;
+    std::int16_t delta;
+};
+
+std::vector<char> records()
+{
+    return {0, 0, 1, 2, 7, 'x', -2, -1,
+            0, 0, 0, 5, 9, 'y', 3, 1};
+}
+
+TEST(layout, decode_record)
+{
+    auto bytes = records();
+    auto view = mv::make_memory_view(bytes);
+    ASSERT_THAT(view.decode<record_layout>(), ::testing::FieldsAre(258, 7, -2));
+    auto second = view(8, mv::end).decode<record_layout, record>();
+    ASSERT_EQ(second.id, 5);
+    ASSERT_EQ(second.kind, 9);
+    ASSERT_EQ(second.delta, 259);
+}
+
+TEST(layout, decode_columns)
+{
+    auto bytes = records();
+    bytes.push_back(0);  // An incomplete record is ignored.
+    auto view = mv::make_memory_view(bytes);
+    auto [ids, kinds, deltas] = view.decode_columns<record_layout>();
+    ASSERT_THAT(ids, ::testing::ElementsAre(258, 5));
+    ASSERT_THAT(kinds, ::testing::ElementsAre(7, 9));
+    ASSERT_THAT(deltas, ::testing::ElementsAre(-2, 259));
+
+    std::array<std::uint32_t, 2> id_column{};
+    std::array<std::uint8_t, 2> kind_column{};
+    std::array<std::int16_t, 1> short_column{};
+    ASSERT_THROW(view.decode_columns<record_layout>(gsl::span<std::uint32_t>(id_column),
+                                                    gsl::span<std::uint8_t>(kind_column),
+                                                    gsl::span<std::int16_t>(short_column)),
+                 std::out_of_range);
+    std::array<std::int16_t, 2> delta_column{};
+    view.decode_columns<record_layout>(gsl::span<std::uint32_t>(id_column),
+                                       gsl::span<std::uint8_t>(kind_column),
+                                       gsl::span<std::int16_t>(delta_column));
+    ASSERT_THAT(delta_column, ::testing::ElementsAre(-2, 259));
+}
+
+TEST(layout, unpack_is_packed)
+{
+    std::vector<char> bytes = {1, 2, 0, 0, 0, 3, 0, 4};
+    auto view = mv::make_memory_view(bytes);
+    ASSERT_THAT((view.unpack<std::int8_t, std::int32_t, std::int16_t>()),
+                ::testing::FieldsAre(1, 2, 3));
+    auto [n, value, tail] = view.unpack_head<std::int8_t, std::int32_t>();
+    ASSERT_EQ(value, 2);
+    ASSERT_THAT(tail.as_span<char>(), ::testing::ElementsAre(3, 0, 4));
+}
+
+TEST(endian, tagged_values)
+{
+    std::vector<char> bytes = {1, 2, 3, 4, 5, 6, 7, 8};
+    auto view = mv::make_memory_view(bytes);
+    ASSERT_EQ(view.as<mv::be<std::uint32_t>>(), 0x01020304u);
+    ASSERT_EQ(view.as<mv::le<std::uint32_t>>(), 0x04030201u);
+    ASSERT_EQ(view(1, mv::end).as<mv::be<std::uint16_t>>(), 0x0203u);
+    ASSERT_THAT((view.unpack<mv::be<std::uint16_t>, std::int8_t, mv::le<std::uint32_t>>()),
+                ::testing::FieldsAre(0x0102u, 3, 0x07060504u));
+}
+
+template<typename T>
+class endian_span : public ::testing::Test {};
+
+using endian_types = ::testing::Types<std::uint16_t, std::int32_t, std::uint64_t, double>;
+TYPED_TEST_SUITE(endian_span, endian_types);
+
+TYPED_TEST(endian_span, converts_into_buffer)
+{
+    std::vector<TypeParam> values(37);
+    std::iota(values.begin(), values.end(), TypeParam{1});
+    std::vector<char> big(1 + values.size() * sizeof(TypeParam));
+    for (std::size_t idx = 0; idx < values.size(); ++idx) {
+        auto* bytes = std::next(big.data(), 1 + idx * sizeof(TypeParam));
+        std::memcpy(bytes, &values[idx], sizeof(TypeParam));
+        if (mv::endian::native != mv::endian::big) {
+            std::reverse(bytes, std::next(bytes, sizeof(TypeParam)));
+        }
+    }
+    auto view = mv::make_memory_view(big)(1, mv::end);
+    std::vector<TypeParam> buffer(values.size());
+    auto span = view.template as_span_be<TypeParam>(gsl::span<TypeParam>(buffer));
+    ASSERT_THAT(span, ::testing::ElementsAreArray(values));
+    std::vector<TypeParam> short_buffer(values.size() - 1);
+    ASSERT_THROW(view.template as_span_be<TypeParam>(gsl::span<TypeParam>(short_buffer)),
+                 std::out_of_range);
+}
+
+TEST(endian, native_order_is_not_copied)
+{
+    std::vector<std::uint32_t> values = {1, 2, 3};
+    auto view = mv::make_memory_view(values);
+    std::array<std::uint32_t, 3> buffer{};
+    auto span = mv::endian::native == mv::endian::little
+        ? view.as_span_le<std::uint32_t>(gsl::span<std::uint32_t>(buffer))
+        : view.as_span_be<std::uint32_t>(gsl::span<std::uint32_t>(buffer));
+    ASSERT_EQ(span.data(), values.data());
+    auto copied = view(1, 9).as_span_le<std::uint32_t>(gsl::span<std::uint32_t>(buffer));
+    ASSERT_EQ(copied.data(), buffer.data());
+    ASSERT_EQ(copied.size(), 2);
+}
+
+std::vector<char> read_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), {});
+}
+
+TEST(mutable_memory_view, growable_buffer)
+{
+    mv::growable_buffer buffer(8);
+    auto header = buffer.append(4);
+    auto body = buffer.append(6).pack_head<std::uint8_t, mv::be<std::uint16_t>>(7, 0x0102);
+    body.store<std::int16_t>(-3);
+    body(2, 3).store<char>('x');
+    auto large = buffer.append(20);
+    std::fill(large.as_writable_ptr(), large.as_writable_ptr() + 20, 'y');
+    header.store<mv::le<std::uint32_t>>(static_cast<std::uint32_t>(buffer.size()));
+    ASSERT_EQ(buffer.size(), 30);
+
+    auto view = buffer.view();
+    ASSERT_EQ(view.size(), 30);
+    ASSERT_EQ(view.as<mv::le<std::uint32_t>>(), 30);
+    ASSERT_THAT((view(4, mv::end).unpack<std::uint8_t, mv::be<std::uint16_t>, std::int16_t, char>()),
+                ::testing::FieldsAre(7, 0x0102, -3, 'x'));
+    ASSERT_EQ(view(29, 30).as<char>(), 'y');
+    ASSERT_EQ(body.size(), 3);
+    ASSERT_EQ(body.as<std::int16_t>(), -3);
+}
+
+TEST(mutable_memory_view, writable_span)
+{
+    mv::growable_buffer buffer;
+    auto view = buffer.append(4 * sizeof(std::uint32_t));
+    auto span = view.as_writable_span<std::uint32_t>();
+    std::iota(span.begin(), span.end(), 1u);
+    ASSERT_THAT(mv::memory_view(view).as_span<std::uint32_t>(),
+                ::testing::ElementsAre(1, 2, 3, 4));
+    ASSERT_FALSE(view(1, 9).is_aligned<std::uint32_t>());
+    view.encode<record_layout>(std::uint32_t{258}, std::uint8_t{7}, std::int16_t{-2});
+    ASSERT_THAT(view.decode<record_layout>(), ::testing::FieldsAre(258, 7, -2));
+    ASSERT_EQ(view.as<char>(), 0);
+}
+
+TEST(mutable_memory_view, mmap)
+{
+    {
+        mv::mutable_memory_view out(mv::mutable_mmap_source("mutable_mmap_file", 8192));
+        ASSERT_TRUE(out(4096, 4100).is_aligned<std::uint32_t>());
+        out.pack<std::uint32_t, mv::be<std::uint32_t>>(11, 12);
+        mv::memory_view misaligned = out(1, 9);
+        ASSERT_FALSE(misaligned.is_aligned<std::uint32_t>());
+        ASSERT_THAT(misaligned.as_sorted<std::uint32_t>().values(),
+                    ::testing::ElementsAre(0u, 12u << 16));
+        out(4096, mv::end).store<std::uint64_t>(13);
+        out(4096, 4104).flush();
+        out.flush(mv::flush_mode::async);
+    }
+    mv::memory_view in(mv::mmap_memory_source("mutable_mmap_file"));
+    ASSERT_EQ(in.size(), 8192);
+    ASSERT_THAT((in.unpack<std::uint32_t, mv::be<std::uint32_t>>()), ::testing::FieldsAre(11, 12));
+    ASSERT_EQ(in(4096, mv::end).as<std::uint64_t>(), 13);
+    std::remove("mutable_mmap_file");
+}
+
+static_assert(!std::is_default_constructible_v<mv::file_sink>);
+
+TEST(mutable_memory_view, file_sink)
+{
+    mv::file_sink sink("file_sink_file");
+    auto first = sink.append(4);
+    {
+        auto second = sink.append(3);
+        second.pack<char, char, char>('e', 'f', 'g');
+    }
+    std::vector<std::thread> threads;
+    for (int idx = 0; idx < 4; ++idx) {
+        threads.emplace_back([&sink]() {
+            for (int round = 0; round < 100; ++round) { sink.append(2).pack<char, char>('x', 'y'); }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    first.pack<char, char>('a', 'b');
+    first(2, 4).flush();
+    sink.sync();
+    ASSERT_EQ(sink.size(), 807);
+    auto content = read_file("file_sink_file");
+    ASSERT_EQ(content.size(), 807);
+    ASSERT_EQ(std::string(content.begin() + 4, content.begin() + 7), "efg");
+    ASSERT_EQ(std::count(content.begin(), content.end(), 'x'), 400);
+    first(2, 4).pack<char, char>('c', 'd');
+    first = mv::mutable_memory_view();
+    sink.sync();
+    ASSERT_EQ(std::string(read_file("file_sink_file").data(), 7), "abcdefg");
+    std::remove("file_sink_file");
+}
+
+TEST(mutable_memory_view, file_sink_write_failure)
+{
+    if (access("/dev/full", W_OK) != 0) { GTEST_SKIP() << "/dev/full is not available"; }
+    {
+        mv::file_sink sink("/dev/full");
+        sink.append(4).pack<char, char, char, char>('a', 'b', 'c', 'd');
+        ASSERT_THROW(sink.sync(), std::system_error);
+    }
+#if !defined(NDEBUG) && GTEST_HAS_DEATH_TEST
+    auto unsynced = []() {
+        mv::file_sink sink("/dev/full");
+        sink.append(4).pack<char, char, char, char>('a', 'b', 'c', 'd');
+    };
+    ASSERT_DEATH(unsynced(), "sync\\(\\) was never called");
+#endif
+}
+
+TEST(numa_memory_source, placements)
+{
+    std::vector<char> data(3 << 20);
+    std::iota(data.begin(), data.end(), 0);
+    memory_view source(ptr_memory_source(data.data(), data.size()));
+    for (auto placement : {mv::numa_placement::first_touch, mv::numa_placement::interleave,
+                           mv::numa_placement::replicate}) {
+        for (auto pages :
+             {mv::page_kind::normal, mv::page_kind::transparent_huge, mv::page_kind::explicit_huge}) {
+            mv::numa_memory_source numa(source, placement, pages);
+            ASSERT_GE(numa.replicas(), 1);
+            if (pages != mv::page_kind::explicit_huge) { ASSERT_EQ(numa.pages(), pages); }
+            if (placement == mv::numa_placement::first_touch) { ASSERT_FALSE(numa.bound(0)); }
+            ASSERT_FALSE(numa.bound(numa.replicas()));
+            memory_view view(numa);
+            ASSERT_EQ(view.size(), data.size());
+            ASSERT_TRUE(view.is_aligned<std::uint64_t>());
+            std::vector<std::thread> threads;
+            std::atomic<bool> equal{true};
+            for (int idx = 0; idx < 4; ++idx) {
+                threads.emplace_back([&, idx]() {
+                    auto part = view(idx << 10, data.size() - (idx << 10));
+                    if (std::memcmp(part.as_ptr(), &data[idx << 10], part.size()) != 0) {
+                        equal = false;
+                    }
+                });
+            }
+            for (auto& thread : threads) { thread.join(); }
+            ASSERT_TRUE(equal);
+        }
+    }
+    mv::numa_memory_source empty(memory_view(ptr_memory_source(data.data(), 0)));
+    ASSERT_EQ(memory_view(empty).size(), 0);
+    ASSERT_TRUE(memory_view(mv::numa_memory_source()).empty());
+}
+
+TEST(numa_memory_source, unbound_fallback)
+{
+    auto pages = mv::page_kind::normal;
+    std::size_t length = 1 << 16;
+    char* addr = mv::detail::map_anonymous(length, pages);
+    auto offline = mv::detail::numa_nodes().back() + 1;
+    ASSERT_FALSE(mv::detail::bind_to_nodes(addr, length, {offline}));
+    ASSERT_FALSE(mv::detail::bind_to_nodes(nullptr, length, {0}));
+    // Memory that could not be bound is still usable where it is first touched.
+    std::memset(addr, 7, length);
+    ASSERT_EQ(addr[length - 1], 7);
+    munmap(addr, mv::detail::anonymous_length(length, pages));
+
+    std::vector<char> data(1 << 16);
+    std::iota(data.begin(), data.end(), 0);
+    for (auto placement : {mv::numa_placement::interleave, mv::numa_placement::replicate}) {
+        mv::numa_memory_source numa(memory_view(ptr_memory_source(data.data(), data.size())),
+                                    placement, mv::page_kind::normal);
+        // Whether or not the kernel accepted the policy, the copy holds the data.
+        memory_view view(numa);
+        ASSERT_EQ(std::memcmp(view.as_ptr(), data.data(), data.size()), 0);
+    }
+    mv::numa_memory_source empty(memory_view(ptr_memory_source(data.data(), 0)),
+                                 mv::numa_placement::interleave);
+    ASSERT_FALSE(empty.bound(0));
+    ASSERT_FALSE(mv::numa_memory_source().bound(0));
+}
+
+TEST(load_into_memory, view)
+{
+    std::vector<std::uint32_t> data(100'000);
+    std::iota(data.begin(), data.end(), 0);
+    memory_view source = mv::make_memory_view(data);
+    mv::load_options options;
+    options.threads = 4;
+    options.chunk_size = 1000;
+    auto loaded = mv::load_into_memory(source, options);
+    ASSERT_EQ(loaded.size(), source.size());
+    ASSERT_TRUE(loaded.is_aligned<std::uint64_t>());
+    ASSERT_THAT(loaded.as_span<std::uint32_t>(), ::testing::ElementsAreArray(data));
+    ASSERT_EQ(mv::load_into_memory(memory_view(ptr_memory_source(nullptr, 0))).size(), 0);
+}
+
+TEST(load_into_memory, file)
+{
+    std::vector<std::uint32_t> data(100'001);
+    std::iota(data.begin(), data.end(), 0);
+    {
+        std::ofstream out("tmpfile");
+        out.write(reinterpret_cast<char*>(data.data()), data.size() * sizeof(std::uint32_t));
+    }
+    for (bool direct : {false, true}) {
+        mv::load_options options;
+        options.threads = 3;
+        options.chunk_size = 10'000;
+        options.direct = direct;
+        options.pages = mv::page_kind::normal;
+        auto loaded = mv::load_into_memory(std::string("tmpfile"), options);
+        ASSERT_THAT(loaded.as_span<std::uint32_t>(), ::testing::ElementsAreArray(data));
+    }
+    ASSERT_THROW(mv::load_into_memory(std::string("missing_file")), std::system_error);
+}
+
+TEST(load_into_memory, direct_reads_rejected)
+{
+    std::vector<std::uint32_t> data(100'001);
+    std::iota(data.begin(), data.end(), 0);
+    {
+        std::ofstream out("tmpfile");
+        out.write(reinterpret_cast<char*>(data.data()), data.size() * sizeof(std::uint32_t));
+    }
+    static std::atomic<int> rejected{0};
+    auto read_direct = [](int fd, char* out, std::size_t begin, std::size_t end) {
+        if ((fcntl(fd, F_GETFL) & O_DIRECT) != 0) {
+            ++rejected;
+            throw std::system_error(std::make_error_code(std::errc::invalid_argument), "pread");
+        }
+        mv::detail::pread_direct(fd, out, begin, end);
+    };
+    mv::load_options options;
+    options.threads = 4;
+    options.chunk_size = 10'000;
+    options.direct = true;
+    options.pages = mv::page_kind::normal;
+    auto loaded = mv::detail::load_file("tmpfile", options, read_direct);
+    ASSERT_LE(rejected.load(), 1);
+    ASSERT_THAT(loaded.as_span<std::uint32_t>(), ::testing::ElementsAreArray(data));
+}
+
+TEST(load_into_memory, direct_read_of_partial_page)
+{
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<char> data(2 * page + 123);
+    std::iota(data.begin(), data.end(), 0);
+    {
+        std::ofstream out("tmpfile");
+        out.write(data.data(), data.size());
+    }
+    int fd = open("tmpfile", O_RDONLY | O_DIRECT);
+    if (fd < 0) { fd = open("tmpfile", O_RDONLY); }
+    ASSERT_GE(fd, 0);
+    auto [buffer, state] = mv::detail::map_owned(data.size(), mv::page_kind::normal);
+    mv::detail::pread_direct(fd, buffer, 0, data.size());
+    ASSERT_TRUE(std::equal(data.begin(), data.end(), buffer));
+    std::fill(buffer, buffer + data.size(), 0);
+    mv::detail::pread_direct(fd, buffer, page, data.size());
+    ASSERT_TRUE(std::equal(std::next(data.begin(), page), data.end(), buffer));
+    ASSERT_THROW(mv::detail::pread_direct(fd, buffer, 3 * page, 4 * page), std::system_error);
+    close(fd);
+}
+
+/// Transport serving a vector, recording the requested ranges.
+class fake_transport {
+public:
+    fake_transport(const std::vector<char>& data,
+                   std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>>& requests,
+                   std::mutex& mutex)
+        : data_(data), requests_(requests), mutex_(mutex)
+    {}
+    std::size_t size() const { return data_.size(); }
+    void get(std::ptrdiff_t begin, std::ptrdiff_t end, char* out) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.emplace_back(begin, end);
+        }
+        std::copy(data_.begin() + begin, data_.begin() + end, out);
+    }
+
+private:
+    const std::vector<char>& data_;
+    std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>>& requests_;
+    std::mutex& mutex_;
+};
+
+static_assert(!std::is_default_constructible_v<mv::remote_memory_source<fake_transport>>);
+
+class remote_memory_source_suite : public ::testing::Test {
+protected:
+    remote_memory_source_suite() : data(1000) { std::iota(data.begin(), data.end(), 0); }
+
+    mv::memory_view make_view(std::size_t gap)
+    {
+        return mv::memory_view(mv::remote_memory_source(
+            fake_transport(data, requests, mutex), 64, cache, gap));
+    }
+
+    std::vector<char> data;
+    std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>> requests;
+    std::mutex mutex;
+    std::shared_ptr<mv::block_cache> cache = std::make_shared<mv::block_cache>(1 << 20);
+};
+
+TEST_F(remote_memory_source_suite, fetches_missing_blocks)
+{
+    auto view = make_view(0);
+    ASSERT_EQ(view.size(), 1000);
+    ASSERT_TRUE(std::equal(data.begin() + 10, data.begin() + 150, view(10, 150).as_ptr()));
+    ASSERT_THAT(requests, ::testing::ElementsAre(std::make_pair(0, 192)));
+    ASSERT_EQ(view(100, 101).as<char>(), data[100]);
+    ASSERT_EQ(view(960, mv::end).as_span<char>().size(), 40);
+    ASSERT_THAT(requests, ::testing::ElementsAre(std::make_pair(0, 192),
+                                                 std::make_pair(960, 1000)));
+}
+
+TEST_F(remote_memory_source_suite, coalesces_nearby_ranges)
+{
+    auto view = make_view(64);
+    view(70, 80).as_ptr();
+    std::vector<std::ptrdiff_t> offsets = {330, 0, 130, 900};
+    std::vector<mv::memory_view> views;
+    for (auto offset : offsets) { views.push_back(view(offset, offset + 10)); }
+    mv::fetch(views);
+    // Blocks 0 and 2 are not requested together, since block 1 between
+    // them is cached, and blocks 5 and 14 are too far from the others.
+    ASSERT_THAT(requests, ::testing::ElementsAre(std::make_pair(64, 128),
+                                                 std::make_pair(0, 64),
+                                                 std::make_pair(128, 192),
+                                                 std::make_pair(320, 384),
+                                                 std::make_pair(896, 960)));
+    requests.clear();
+    view(200, 310).as_ptr();
+    ASSERT_THAT(requests, ::testing::ElementsAre(std::make_pair(192, 320)));
+    for (std::size_t idx = 0; idx < views.size(); ++idx) {
+        ASSERT_EQ(views[idx].as<char>(), data[offsets[idx]]);
+    }
+}
+
+TEST_F(remote_memory_source_suite, prefetch_in_background)
+{
+    {
+        auto view = make_view(0);
+        view(500, 700).prefetch();
+        for (int attempt = 0; attempt < 1000 && cache->size() < 256; ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_EQ(cache->size(), 256);
+        ASSERT_EQ(view(520, 530).as<char>(), data[520]);
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(requests.size(), 1);
+    }
+    // Wait for the prefetching thread to release the source.
+    for (int attempt = 0; attempt < 1000 && cache->size() > 0; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(cache->size(), 0);
+}
+
+TEST_F(remote_memory_source_suite, zero_block_size)
+{
+    ASSERT_THROW(mv::remote_memory_source(fake_transport(data, requests, mutex), 0, cache),
+                 std::invalid_argument);
+}
+
+TEST(shared_block_cache, single_budget)
+{
+    std::vector<char> first(16, 1);
+    std::vector<char> second(16, 2);
+    int first_fetches = 0;
+    int second_fetches = 0;
+    auto cache = std::make_shared<mv::block_cache>(16, 4);
+    {
+        auto a = mv::memory_view(
+            mv::cached_memory_source(counting_source(first, first_fetches), 4, cache));
+        auto b = mv::memory_view(
+            mv::cached_memory_source(counting_source(second, second_fetches), 4, cache));
+        for (std::ptrdiff_t pos = 0; pos < 16; pos += 4) {
+            ASSERT_EQ(a(pos, pos + 4).as<char>(), 1);
+            ASSERT_EQ(b(pos, pos + 4).as<char>(), 2);
+            ASSERT_LE(cache->size(), cache->capacity());
+        }
+        ASSERT_EQ(first_fetches, 4);
+        ASSERT_EQ(second_fetches, 4);
+        ASSERT_GT(cache->size(), 0);
+
+        // A pinned block survives shrinking the budget.
+        auto pinned = a(0, 4);
+        pinned.as_ptr();
+        auto fetched = first_fetches;
+        cache->set_capacity(0);
+        ASSERT_EQ(cache->size(), 4);
+        a(1, 2).as_ptr();
+        ASSERT_EQ(first_fetches, fetched);
+        cache->set_capacity(16);
+        b(0, 4).as_ptr();
+        ASSERT_EQ(cache->size(), 8);
+    }
+    // Destroyed sources leave no blocks behind.
+    ASSERT_EQ(cache->size(), 0);
+}
+
+TEST(shared_block_cache, concurrent_sources)
+{
+    std::vector<std::vector<char>> files;
+    for (int file = 0; file < 8; ++file) {
+        std::vector<char> data(1024);
+        std::iota(data.begin(), data.end(), static_cast<char>(file));
+        files.push_back(std::move(data));
+    }
+    auto cache = std::make_shared<mv::block_cache>(2048, 8);
+    std::vector<mv::memory_view> views;
+    for (const auto& data : files) {
+        views.push_back(mv::memory_view(
+            mv::cached_memory_source(mv::ptr_memory_source(data), 64, cache)));
+    }
+    std::vector<std::thread> threads;
+    std::atomic<int> errors{0};
+    for (int thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&, thread]() {
+            for (int round = 0; round < 2000; ++round) {
+                auto file = (round * 7 + thread) % files.size();
+                std::ptrdiff_t pos = (round * 37 + thread * 11) % 1000;
+                auto view = views[file](pos, pos + 24);
+                if (!std::equal(view.as_span<char>().begin(),
+                                view.as_span<char>().end(),
+                                std::next(files[file].begin(), pos))) {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    ASSERT_EQ(errors, 0);
+    ASSERT_LE(cache->size(), cache->capacity());
+}
+
+static_assert(mv::detail::has_slice_many<
+              mv::instrumented_source<mv::istream_memory_source>>::value);
+static_assert(!mv::detail::has_advise<
+              mv::instrumented_source<mv::istream_memory_source>>::value);
+
+TEST(instrumented_source, counts_fetches)
+{
+    std::string data = "abcdefgh";
+    std::istringstream is(data);
+    auto stats = std::make_shared<mv::fetch_stats>();
+    mv::memory_view view(
+        mv::instrumented_source(mv::istream_memory_source(is, data.size()), stats));
+    auto head = view(0, 3);
+    ASSERT_EQ(std::string(head.as_ptr(), 3), "abc");
+    ASSERT_EQ(std::string(head.as_ptr(), 3), "abc");
+    ASSERT_EQ(stats->fetches(), 1);
+    ASSERT_EQ(stats->bytes(), 3);
+
+    std::vector<mv::memory_view> views = {view(4, 8), view(0, 2)};
+    mv::fetch(views);
+    ASSERT_EQ(stats->batches(), 1);
+    ASSERT_EQ(stats->fetches(), 3);
+    ASSERT_EQ(stats->bytes(), 9);
+    auto histogram = stats->latency_histogram();
+    ASSERT_EQ(std::accumulate(histogram.begin(), histogram.end(), std::uint64_t{0}), 3);
+    ASSERT_GT(stats->latency_percentile(1.0), 0);
+
+    stats->reset();
+    ASSERT_EQ(stats->fetches(), 0);
+    ASSERT_EQ(stats->latency_percentile(0.5), 0);
+
+    mv::instrumented_source<mv::mmap_memory_source> empty;
+    empty.slice(0, 0);
+    ASSERT_EQ(empty.stats().fetches(), 1);
+}
+
+TEST(block_cache, hits_and_misses)
+{
+    std::vector<char> data = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int fetches = 0;
+    mv::cached_memory_source source(counting_source(data, fetches), 4, 8);
+    mv::memory_view view(source);
+    view(0, 1).as_ptr();
+    view(1, 2).as_ptr();
+    view(2, 6).as_ptr();
+    ASSERT_EQ(source.cache().misses(), 2);
+    ASSERT_EQ(source.cache().hits(), 2);
+    ASSERT_EQ(source.cache().misses(), fetches);
+}
+
+TEST(block_cache, snapshot_and_warm_up)
+{
+    std::vector<char> data(64);
+    std::iota(data.begin(), data.end(), 0);
+    mv::cache_snapshot snapshot;
+    {
+        int fetches = 0;
+        auto cache = std::make_shared<mv::block_cache>(64, 2);
+        mv::cached_memory_source named(counting_source(data, fetches), 8, cache);
+        mv::cached_memory_source unnamed(counting_source(data, fetches), 8, cache);
+        cache->name_source(named.source_id(), "named");
+        mv::memory_view{unnamed}(0, 1).as_ptr();
+        mv::memory_view view(named);
+        view(40, 41).as_ptr();
+        view(8, 9).as_ptr();
+        view(20, 21).as_ptr();
+        ASSERT_EQ(cache->snapshot().entries.size(), 3);
+        ASSERT_EQ(cache->snapshot(1).entries.size(), 1);
+        cache->snapshot().save("cache_snapshot_file");
+    }
+    snapshot = mv::cache_snapshot::load("cache_snapshot_file");
+    ASSERT_EQ(snapshot.entries.size(), 3);
+    std::vector<std::uint64_t> offsets;
+    for (const auto& entry : snapshot.entries) {
+        ASSERT_EQ(entry.source, "named");
+        ASSERT_EQ(entry.size, 8);
+        offsets.push_back(entry.offset);
+    }
+    ASSERT_THAT(offsets, ::testing::UnorderedElementsAre(8, 16, 40));
+
+    int fetches = 0;
+    mv::cached_memory_source source(counting_source(data, fetches), 8, 64);
+    mv::memory_view view(source);
+    mv::warm_up(snapshot, {{"named", view}, {"other", view}});
+    ASSERT_EQ(fetches, 3);
+    view(16, 24).as_ptr();
+    view(44, 48).as_ptr();
+    ASSERT_EQ(fetches, 3);
+
+    int async_fetches = 0;
+    mv::cached_memory_source async_source(counting_source(data, async_fetches), 8, 64);
+    auto started = std::chrono::steady_clock::now();
+    mv::warm_up_async(snapshot, {{"named", mv::memory_view(async_source)}}, 1000).get();
+    ASSERT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(20));
+    ASSERT_EQ(async_fetches, 3);
+
+    // A corrupted size that would wrap past the end of the view.
+    int clamped_fetches = 0;
+    mv::cached_memory_source clamped_source(counting_source(data, clamped_fetches), 8, 64);
+    mv::cache_snapshot corrupted;
+    corrupted.entries.push_back({"named", 16, ~std::uint64_t{0} - 8});
+    mv::warm_up(corrupted, {{"named", mv::memory_view(clamped_source)}}, 1 << 20);
+    ASSERT_EQ(clamped_fetches, 6);
+
+    {
+        std::ofstream out("cache_snapshot_file");
+        out << "garbage";
+    }
+    ASSERT_THROW(mv::cache_snapshot::load("cache_snapshot_file"), std::runtime_error);
+    {
+        // A name count far beyond the size of the file.
+        std::ofstream out("cache_snapshot_file", std::ios::binary);
+        out << "mvc1\xFF\xFF\xFF\xFF";
+    }
+    ASSERT_THROW(mv::cache_snapshot::load("cache_snapshot_file"), std::runtime_error);
+    std::remove("cache_snapshot_file");
+}
+
+TEST(crc32c, known_values)
+{
+    std::string data = "123456789";
+    ASSERT_EQ(mv::crc32c(data.data(), data.size()), 0xE3069283u);
+    ASSERT_EQ(mv::crc32c(data.data() + 4, 5, mv::crc32c(data.data(), 4)), 0xE3069283u);
+    ASSERT_EQ(mv::crc32c(nullptr, 0), 0u);
+}
+
+TEST(crc32c, table_matches_instructions)
+{
+    std::vector<char> data(100);
+    std::iota(data.begin(), data.end(), 0);
+    for (std::size_t size = 0; size <= data.size(); size += 7) {
+        ASSERT_EQ(~mv::detail::crc32c_sliced(data.data(), size, ~0u),
+                  mv::crc32c(data.data(), size));
+    }
+    std::string digits = "123456789";
+    ASSERT_EQ(~mv::detail::crc32c_sliced(digits.data(), digits.size(), ~0u), 0xE3069283u);
+}
+
+TEST(verified_memory_source, lazy_verification)
+{
+    std::vector<char> data(100);
+    std::iota(data.begin(), data.end(), 0);
+    auto checksums = mv::block_checksums(mv::make_memory_view(data), 16);
+    ASSERT_EQ(checksums.size(), 7);
+    data[40] = 0;
+    int fetches = 0;
+    mv::verified_memory_source source(counting_source(data, fetches), 16, checksums);
+    memory_view view(source);
+    ASSERT_EQ(view(18, 20).as<char>(), 18);
+    ASSERT_TRUE(source.verified(1));
+    ASSERT_FALSE(source.verified(0));
+    ASSERT_EQ(view(90, 100).as<char>(), 90);
+    ASSERT_TRUE(source.verified(6));
+    ASSERT_THROW(view(30, 34).as_ptr(), mv::checksum_error);
+    ASSERT_FALSE(source.verified(2));
+    try {
+        view(40, 41).as_ptr();
+        FAIL();
+    } catch (const mv::checksum_error& error) {
+        ASSERT_EQ(error.block(), 2);
+    }
+    ASSERT_EQ(view(50, 52).as<char>(), 50);
+    ASSERT_THROW(mv::verified_memory_source(counting_source(data, fetches), 32, checksums),
+                 std::runtime_error);
+    ASSERT_THROW(mv::verified_memory_source(counting_source(data, fetches), 0, checksums),
+                 std::invalid_argument);
+    ASSERT_THROW(mv::block_checksums(mv::make_memory_view(data), 0), std::invalid_argument);
+}
+
+TEST(verified_memory_source, batched)
+{
+    std::vector<char> data(4096);
+    std::iota(data.begin(), data.end(), 0);
+    {
+        std::ofstream out("tmpfile");
+        out.write(data.data(), data.size());
+    }
+    mv::verified_memory_source source(
+        mv::file_memory_source("tmpfile"), 512, mv::block_checksums(mv::make_memory_view(data), 512));
+    memory_view view(source);
+    std::vector<memory_view> views = {view(10, 20), view(1024, 1536), view(3000, 3100)};
+    mv::fetch(gsl::span<memory_view>(views));
+    ASSERT_TRUE(source.verified(0));
+    ASSERT_TRUE(source.verified(2));
+    ASSERT_TRUE(source.verified(5));
+    ASSERT_FALSE(source.verified(1));
+    ASSERT_EQ(views[1].as<char>(), data[1024]);
+    ASSERT_EQ(views[2].as<char>(), data[3000]);
+    ASSERT_EQ(view(510, 520).as<char>(), data[510]);
+    ASSERT_TRUE(source.verified(1));
+}
+
+TEST(parallel, for_each_and_reduce)
+{
+    std::vector<std::uint64_t> values(100'003);
+    std::iota(values.begin(), values.end(), 0);
+    auto view = mv::make_memory_view(values);
+    mv::parallel_options options;
+    options.threads = 4;
+    options.chunk_size = 1000;
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::size_t> chunks{0};
+    mv::parallel_for_each<std::uint64_t>(
+        view,
+        [&](memory_view chunk) {
+            ASSERT_EQ(chunk.size() % sizeof(std::uint64_t), 0);
+            auto span = chunk.as_span<std::uint64_t>();
+            sum += std::accumulate(span.begin(), span.end(), std::uint64_t{0});
+            ++chunks;
+        },
+        options);
+    ASSERT_EQ(sum, std::accumulate(values.begin(), values.end(), std::uint64_t{0}));
+    ASSERT_EQ(chunks, (view.size() + 1023) / 1024);
+
+    // Chunks are combined in order.
+    auto first_values = mv::parallel_reduce<std::uint64_t>(
+        view,
+        std::vector<std::uint64_t>{},
+        [](memory_view chunk) { return std::vector<std::uint64_t>{chunk.as<std::uint64_t>()}; },
+        [](auto lhs, auto rhs) {
+            lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+            return lhs;
+        },
+        options);
+    ASSERT_TRUE(std::is_sorted(first_values.begin(), first_values.end()));
+    ASSERT_EQ(first_values.size(), chunks);
+
+    ASSERT_EQ(mv::parallel_reduce(memory_view(ptr_memory_source(nullptr, 0)), 7,
+                                  [](memory_view) { return 1; }, std::plus<>{}),
+              7);
+    ASSERT_THROW(mv::parallel_for_each(
+                     view, [](memory_view) { throw std::runtime_error("fail"); }, options),
+                 std::runtime_error);
+}
+
+TEST(parallel, lazy_source)
+{
+    std::vector<char> data(1 << 16, 1);
+    std::atomic<int> fetches{0};
+    memory_view view(slow_source(data, fetches));
+    mv::parallel_options options;
+    options.threads = 8;
+    options.chunk_size = 4096;
+    auto started = std::chrono::steady_clock::now();
+    auto sum = mv::parallel_reduce(
+        view,
+        0,
+        [](memory_view chunk) {
+            auto span = chunk.as_span<char>();
+            return std::accumulate(span.begin(), span.end(), 0);
+        },
+        std::plus<>{},
+        options);
+    ASSERT_EQ(sum, 1 << 16);
+    ASSERT_EQ(fetches, 16);
+    ASSERT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(160));
+}
+
+template<typename T>
+class sorted_views : public ::testing::Test {};
+
+using sorted_types = ::testing::Types<std::uint32_t, std::int32_t, std::uint64_t, double>;
+TYPED_TEST_SUITE(sorted_views, sorted_types);
+
+TYPED_TEST(sorted_views, lower_bound)
+{
+    using T = TypeParam;
+    for (std::size_t count : {0, 1, 5, 16, 17, 100, 1000}) {
+        std::vector<T> values;
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            values.push_back(static_cast<T>(3 * static_cast<int>(idx) - 50) / 2 * 2);
+        }
+        std::sort(values.begin(), values.end());
+        auto sorted = mv::make_memory_view(values).template as_sorted<T>();
+        auto layout = mv::eytzinger_layout(gsl::span<const T>(values));
+        auto eytzinger = mv::make_memory_view(layout).template as_eytzinger<T>();
+        ASSERT_EQ(sorted.size(), count);
+        for (int probe = -60; probe < 3 * static_cast<int>(count); ++probe) {
+            auto value = static_cast<T>(probe);
+            auto expected = static_cast<std::size_t>(
+                std::lower_bound(values.begin(), values.end(), value) - values.begin());
+            ASSERT_EQ(sorted.lower_bound(value), expected);
+            ASSERT_EQ(sorted.lower_bound(value, expected / 2), expected);
+            auto pos = eytzinger.lower_bound(value);
+            if (expected == count) {
+                ASSERT_EQ(pos, count);
+            } else {
+                ASSERT_EQ(eytzinger[pos], values[expected]);
+            }
+            ASSERT_EQ(sorted.contains(value), eytzinger.contains(value));
+            ASSERT_EQ(sorted.contains(value), std::binary_search(values.begin(), values.end(), value));
+        }
+    }
+}
+
+TEST(sorted_view, unsigned_extremes)
+{
+    std::vector<std::uint32_t> values(40);
+    std::iota(values.begin(), values.end(), 0x7FFFFFF0u);
+    values.back() = 0xFFFFFFFFu;
+    auto sorted = mv::make_memory_view(values).as_sorted<std::uint32_t>();
+    ASSERT_EQ(sorted.lower_bound(0x80000000u), 16);
+    ASSERT_EQ(sorted.lower_bound(0xFFFFFFFEu), 39);
+    ASSERT_EQ(sorted.lower_bound(0), 0);
+    ASSERT_EQ(sorted.lower_bound(0x80000005u, 30), 30);
+    ASSERT_EQ(sorted.lower_bound(0x80000005u, 100), 40);
+}
+
+TEST(indexed_view, encodings)
+{
+    std::vector<std::string> records;
+    std::mt19937 gen(3);
+    for (int idx = 0; idx < 2000; ++idx) {
+        records.push_back(std::string(gen() % (idx % 100 == 0 ? 5000 : 40), 'a' + idx % 26));
+    }
+    for (auto input : {std::vector<std::string>{}, std::vector<std::string>{""}, records}) {
+        for (auto encoding : {mv::offset_encoding::plain, mv::offset_encoding::elias_fano}) {
+            auto data = mv::encode_indexed(input, encoding);
+            auto indexed = mv::make_memory_view(data).as_indexed();
+            ASSERT_EQ(indexed.encoding(), encoding);
+            ASSERT_EQ(indexed.size(), input.size());
+            for (std::size_t idx = 0; idx < input.size(); ++idx) {
+                auto record = indexed[idx];
+                ASSERT_EQ(std::string(record.data(), record.size()), input[idx]);
+            }
+            std::size_t idx = 0;
+            for (auto record : indexed) {
+                ASSERT_EQ(std::string(record.data(), record.size()), input[idx++]);
+            }
+            ASSERT_EQ(idx, input.size());
+        }
+    }
+    auto plain = mv::encode_indexed(records);
+    auto compressed = mv::encode_indexed(records, mv::offset_encoding::elias_fano);
+    ASSERT_LT(compressed.size() + 6 * records.size(), plain.size());
+}
+
+TEST(indexed_view, invalid)
+{
+    std::vector<std::string> records = {"ab", "cde"};
+    for (auto encoding : {mv::offset_encoding::plain, mv::offset_encoding::elias_fano}) {
+        auto data = mv::encode_indexed(records, encoding);
+        for (std::size_t size = 0; size < data.size(); ++size) {
+            ASSERT_THROW(mv::make_memory_view(data.substr(0, size)).as_indexed(), std::runtime_error);
+        }
+        data[8] = 7;
+        ASSERT_THROW(mv::make_memory_view(data).as_indexed(), std::runtime_error);
+    }
+
+    auto plain = mv::encode_indexed(records);
+    plain[24] = 100;
+    ASSERT_THROW(mv::make_memory_view(plain).as_indexed(), std::runtime_error);
+    plain[24] = 2;
+    plain[16] = 3;
+    ASSERT_THROW(mv::make_memory_view(plain).as_indexed(), std::runtime_error);
+
+    // The offsets 0, 2 and 5 take one low bit each, so setting the low bit
+    // of the first one and moving the high bit of the second one down
+    // decodes them as 1 and 0.
+    auto elias_fano = mv::encode_indexed(records, mv::offset_encoding::elias_fano);
+    ASSERT_EQ(elias_fano[16], 1);
+    ASSERT_EQ(elias_fano[32], 0x04);
+    ASSERT_EQ(elias_fano[48], 0x15);
+    elias_fano[32] = 0x05;
+    elias_fano[48] = 0x13;
+    ASSERT_THROW(mv::make_memory_view(elias_fano).as_indexed(), std::runtime_error);
+}
+
+#ifdef MEMORY_VIEW_TRACING
+
+TEST(tracing, counts_allocations)
+{
+    mv::trace::scope scope;
+    auto value = std::make_unique<int>(1);
+    ASSERT_EQ(scope.allocations(), 1);
+}
+
+TEST(tracing, slicing_static_memory_does_not_allocate)
+{
+    std::vector<std::uint32_t> data(1024, 7);
+    auto view = mv::make_memory_view(data);
+    mv::trace::scope scope;
+    std::uint64_t sum = 0;
+    for (std::ptrdiff_t pos = 0; pos < static_cast<std::ptrdiff_t>(view.size()); pos += 4) {
+        sum += view(pos, pos + 4).as<std::uint32_t>();
+    }
+    auto [first, second] = view(0, 8).unpack<std::uint32_t, std::uint32_t>();
+    ASSERT_EQ(sum + first + second, 7 * 1026);
+    ASSERT_EQ(scope.allocations(), 0);
+    ASSERT_EQ(scope.bytes_copied(), 0);
+}
+
+TEST(tracing, fetched_views_are_not_fetched_again)
+{
+    std::vector<char> data(64, 1);
+    int fetches = 0;
+    memory_view view(counting_source(data, fetches));
+    mv::trace::scope scope;
+    auto field = view(8, 12);
+    field.as<std::int32_t>();
+    field.as<std::int32_t>();
+    ASSERT_EQ(scope.slices(), 1);
+    view.materialize();
+    view(16, 20).as<std::int32_t>();
+    view(20, 24).as_span<char>();
+    ASSERT_EQ(scope.slices(), 2);
+    ASSERT_EQ(scope.slices(), static_cast<std::uint64_t>(fetches));
+}
+
+TEST(tracing, counts_copies_across_blocks)
+{
+    std::vector<char> data(64, 1);
+    int fetches = 0;
+    memory_view view(mv::cached_memory_source(counting_source(data, fetches), 16, 64));
+    mv::trace::scope scope;
+    view(4, 12).as_ptr();
+    ASSERT_EQ(scope.bytes_copied(), 0);
+    view(12, 40).as_ptr();
+    ASSERT_EQ(scope.bytes_copied(), 28);
+    std::array<std::uint32_t, 4> buffer{};
+    view(1, 17).as_span_be<std::uint32_t>(gsl::span<std::uint32_t>(buffer));
+    ASSERT_EQ(scope.bytes_copied(), 28 + 16 + 16);
+}
+
+TEST(tracing, basic_views_convert_without_allocating)
+{
+    std::vector<char> data(64, 1);
+    int fetches = 0;
+    mv::basic_memory_view view(counting_source(data, fetches));
+    mv::memory_view whole = view;
+    mv::trace::scope scope;
+    for (std::ptrdiff_t pos = 0; pos < 64; pos += 4) {
+        mv::memory_view erased = view(pos, pos + 4);
+        ASSERT_EQ(erased.size(), 4);
+    }
+    mv::memory_view again = view;
+    ASSERT_EQ(scope.allocations(), 0);
+    ASSERT_EQ(again.as<char>(), 1);
+    ASSERT_EQ(fetches, 1);
+}
+
+#endif
+
 class dummy_handler {
 public:
     virtual void invalidate() { invalidated = true; };